@@ -72,17 +72,11 @@ unsigned int AnalyticBottomUpStrategy::chooseBeta()
 
 AnalyticTableau::AnalyticTableau(const string& id, SignedFormula *fml,
 				 AnalyticTableau *parent)
-  : Tableau(id, fml, parent)
+  : Tableau(id, fml, parent), _alphas(_branch->alphas),
+    _betas(_branch->betas), _lits(_branch->lits)
 {
   _closed = false;
 
-  // Initialization of _alphas, _betas and _lits
-  if (parent != NULL) {
-    _alphas.insert(_alphas.end(),
-		   parent->_alphas.begin(), parent->_alphas.end());
-    _betas.insert(_betas.end(), parent->_betas.begin(), parent->_betas.end());
-    _lits.insert(_lits.end(), parent->_lits.begin(), parent->_lits.end());  
-  }
 
   // Initialization of _rules
   _rules.push_back(&alpha_E_NOT_OR);
@@ -102,17 +96,11 @@ AnalyticTableau::AnalyticTableau(const string& id, SignedFormula *fml,
 AnalyticTableau::AnalyticTableau(const string& id,
 				 const vector<SignedFormula *>& fmls,
 				 AnalyticTableau *parent)
-  : Tableau(id, fmls, parent)
+  : Tableau(id, fmls, parent), _alphas(_branch->alphas),
+    _betas(_branch->betas), _lits(_branch->lits)
 {
   _closed = false;
 
-  // Initialization of _alphas, _betas and _lits
-  if (parent != NULL) {
-    _alphas.insert(_alphas.end(),
-		   parent->_alphas.begin(), parent->_alphas.end());
-    _betas.insert(_betas.end(), parent->_betas.begin(), parent->_betas.end());
-    _lits.insert(_lits.end(), parent->_lits.begin(), parent->_lits.end());  
-  }
 
   // Initialization of _rules
   _rules.push_back(&alpha_E_NOT_OR);
@@ -132,7 +120,8 @@ AnalyticTableau::AnalyticTableau(const string& id,
 void AnalyticTableau::setStrategy(AnalyticStrategy *strategy) {
   // Initialization of the strategy object
   _strategy = strategy;
-  _strategy->init(_id, &_items, &_alphas, &_betas, &_lits);
+  PhaseTimer timer(_stats, Stats::INIT);
+  _strategy->init(_id, &_items, _branch);
 }
 
 bool alpha_E_NOT_OR(const vector<SignedFormula *>& in,
@@ -142,9 +131,9 @@ bool alpha_E_NOT_OR(const vector<SignedFormula *>& in,
 	 in[0]->formula && in[0]->formula->op == Formula::OR)) return false;
 
   out.push_back(new SignedFormula(SignedFormula::S_F,
-				  new Formula(*(in[0]->formula->left))));
+				  in[0]->formula->left));
   out.push_back(new SignedFormula(SignedFormula::S_F,
-				  new Formula(*(in[0]->formula->right))));
+				  in[0]->formula->right));
 
   return true;
 }
@@ -157,7 +146,7 @@ bool alpha_E_NOT_ORN(const vector<SignedFormula *>& in,
 
   for(unsigned int i = 0; i < in[0]->formula->fmls.size(); i++)
     out.push_back(new SignedFormula(SignedFormula::S_F,
-				    new Formula(*(in[0]->formula->fmls[i]))));
+				    in[0]->formula->fmls[i]));
 
   return true;
 }
@@ -169,9 +158,9 @@ bool alpha_E_AND(const vector<SignedFormula *>& in,
 	 in[0]->formula && in[0]->formula->op == Formula::AND)) return false;
 
   out.push_back(new SignedFormula(SignedFormula::S_T,
-				  new Formula(*(in[0]->formula->left))));
+				  in[0]->formula->left));
   out.push_back(new SignedFormula(SignedFormula::S_T,
-				  new Formula(*(in[0]->formula->right))));
+				  in[0]->formula->right));
 
   return true;
 }
@@ -184,7 +173,7 @@ bool alpha_E_ANDN(const vector<SignedFormula *>& in,
 
   for(unsigned int i = 0; i < in[0]->formula->fmls.size(); i++)
     out.push_back(new SignedFormula(SignedFormula::S_T,
-				    new Formula(*(in[0]->formula->fmls[i]))));
+				    in[0]->formula->fmls[i]));
 
   return true;
 }
@@ -197,9 +186,9 @@ bool alpha_E_NOT_IMPLIES(const vector<SignedFormula *>& in,
     return false;
 
   out.push_back(new SignedFormula(SignedFormula::S_T,
-				  new Formula(*(in[0]->formula->left))));
+				  in[0]->formula->left));
   out.push_back(new SignedFormula(SignedFormula::S_F,
-				  new Formula(*(in[0]->formula->right))));
+				  in[0]->formula->right));
 
   return true;
 }
@@ -211,7 +200,7 @@ bool alpha_E_NOT_NOT(const vector<SignedFormula *>& in,
 	 in[0]->formula && in[0]->formula->op == Formula::NOT)) return false;
 
   out.push_back(new SignedFormula(SignedFormula::S_T,
-				  new Formula(*(in[0]->formula->right))));
+				  in[0]->formula->right));
 
   return true;
 }
@@ -223,7 +212,7 @@ bool alpha_E_NOT(const vector<SignedFormula *>& in,
 	 in[0]->formula && in[0]->formula->op == Formula::NOT)) return false;
 
   out.push_back(new SignedFormula(SignedFormula::S_F,
-				  new Formula(*(in[0]->formula->right))));
+				  in[0]->formula->right));
 
   return true;
 }
@@ -236,9 +225,9 @@ bool beta_E_OR(const vector<SignedFormula *>& in,
     return false;
 
   out.push_back(new SignedFormula(SignedFormula::S_T,
-				  new Formula(*(in[0]->formula->left))));
+				  in[0]->formula->left));
   out.push_back(new SignedFormula(SignedFormula::S_T,
-				  new Formula(*(in[0]->formula->right))));
+				  in[0]->formula->right));
 
   return true;
 }
@@ -252,7 +241,7 @@ bool beta_E_ORN(const vector<SignedFormula *>& in,
 
   for(unsigned int i = 0; i < in[0]->formula->fmls.size(); i++)
     out.push_back(new SignedFormula(SignedFormula::S_T,
-				    new Formula(*(in[0]->formula->fmls[i]))));
+				    in[0]->formula->fmls[i]));
 
   return true;
 }
@@ -265,9 +254,9 @@ bool beta_E_NOT_AND(const vector<SignedFormula *>& in,
     return false;
   
   out.push_back(new SignedFormula(SignedFormula::S_F,
-				  new Formula(*(in[0]->formula->left))));
+				  in[0]->formula->left));
   out.push_back(new SignedFormula(SignedFormula::S_F,
-				  new Formula(*(in[0]->formula->right))));
+				  in[0]->formula->right));
 
   return true;
 }
@@ -281,7 +270,7 @@ bool beta_E_NOT_ANDN(const vector<SignedFormula *>& in,
 
   for(unsigned int i = 0; i < in[0]->formula->fmls.size(); i++)
     out.push_back(new SignedFormula(SignedFormula::S_F,
-				    new Formula(*(in[0]->formula->fmls[i]))));
+				    in[0]->formula->fmls[i]));
 
   return true;
 }
@@ -294,9 +283,9 @@ bool beta_E_IMPLIES(const vector<SignedFormula *>& in,
     return false;
 
   out.push_back(new SignedFormula(SignedFormula::S_F,
-				  new Formula(*(in[0]->formula->left))));
+				  in[0]->formula->left));
   out.push_back(new SignedFormula(SignedFormula::S_T,
-				  new Formula(*(in[0]->formula->right))));
+				  in[0]->formula->right));
 
   return true;
 }
@@ -312,17 +301,20 @@ bool AnalyticTableau::applyRule(AnalyticTableau::enumRule r,
   return result;
 }
 
-bool AnalyticTableau::close()
+AnalyticTableau::Step AnalyticTableau::expand()
 {
   unsigned int c = 0;
 
   if (_closed)
-    return true;
+    return CLOSED;
 
-  _closed = _strategy->classify(c);
+  {
+    PhaseTimer timer(_stats, Stats::CLASSIFY);
+    _closed = _strategy->classify(c);
+  }
 
   if (_closed)
-    return true;
+    return CLOSED;
   
   int nextRule = _strategy->nextRule();
   
@@ -333,23 +325,30 @@ bool AnalyticTableau::close()
 	unsigned int index = _strategy->chooseAlpha();
 	vector<SignedFormula *> in, out;
 	in.push_back(_alphas[index]);
+	{
+	  PhaseTimer timer(_stats, Stats::ALPHA);
+
+	  // exactly one of these will succeed
+	  applyRule(A_E_NOT_OR, in, out);
+	  applyRule(A_E_NOT_ORN, in, out);
+	  applyRule(A_E_AND, in, out);
+	  applyRule(A_E_ANDN, in, out);
+	  applyRule(A_E_NOT_IMPLIES, in, out);
+	  applyRule(A_E_NOT_NOT, in, out);
+	  applyRule(A_E_NOT, in, out);
+
+	  _items.insert(_items.end(), out.begin(), out.end());
+	  _branch->erase(_alphas, index);
+	}
+	if (_stats != NULL)
+	  _stats->count(Stats::ALPHA_RULES);
 	
-	// exactly one of these will succeed
-	applyRule(A_E_NOT_OR, in, out);
-	applyRule(A_E_NOT_ORN, in, out);
-	applyRule(A_E_AND, in, out);
-	applyRule(A_E_ANDN, in, out);
-	applyRule(A_E_NOT_IMPLIES, in, out);
-	applyRule(A_E_NOT_NOT, in, out);
-	applyRule(A_E_NOT, in, out);
-	
-	_items.insert(_items.end(), out.begin(), out.end());
-	vector<SignedFormula *>::iterator it = _alphas.begin() + index;
-	_alphas.erase(it);
-	
-	_closed = _strategy->classify(c);
+	{
+	  PhaseTimer timer(_stats, Stats::CLASSIFY);
+	  _closed = _strategy->classify(c);
+	}
 	if (_closed)
-	  return true;
+	  return CLOSED;
       }
       break;
     case 1: // beta
@@ -358,40 +357,58 @@ bool AnalyticTableau::close()
 	vector<SignedFormula *> in, out;
 	
 	in.push_back(_betas[index]);
-	
-	// exactly one of these will succeed
-	applyRule(B_E_OR, in, out);
-	applyRule(B_E_ORN, in, out);
-	applyRule(B_E_NOT_AND, in, out);
-	applyRule(B_E_NOT_ANDN, in, out);
-	applyRule(B_E_IMPLIES, in, out);
-	
-	vector<SignedFormula *>::iterator it = _betas.begin() + index;
-	_betas.erase(it);
+	{
+	  PhaseTimer timer(_stats, Stats::BETA);
+
+	  // exactly one of these will succeed
+	  applyRule(B_E_OR, in, out);
+	  applyRule(B_E_ORN, in, out);
+	  applyRule(B_E_NOT_AND, in, out);
+	  applyRule(B_E_NOT_ANDN, in, out);
+	  applyRule(B_E_IMPLIES, in, out);
+
+	  _branch->erase(_betas, index);
+	}
+	if (_stats != NULL)
+	  _stats->count(Stats::BETA_RULES);
     
 	// Obs: You cannot create the second child before the call to
 	// close() of the previous child. It leads to a sobreposition of
-	// the members of _strategy.
-	bool closed = true;
-	for (unsigned int ind = 0; ind < out.size() && closed; ind++) {
-	  char cid[1000];
-	  sprintf(cid, "%s-%d", _id.c_str(), ind+1);
-	  createChild(cid, out[ind]);
-	  if (! _children[ind]->close())
-	    closed = false;
-	  setStrategy(_strategy);
-	}
-	return closed;
+	// the members of _strategy. The children are created one at a
+	// time by resume().
+	_out = out;
+	_mark = _branch->mark();
+	return resume(true);
       }
       break;
     default:
-      return false;
+      return OPEN;
     }
     nextRule = _strategy->nextRule();
   }
-  return false;
+  return OPEN;
 }
 
+AnalyticTableau::Step AnalyticTableau::resume(bool closed)
+{
+  unsigned int ind = _children.size();
+
+  if (ind > 0) {
+    _branch->undo(_mark);
+    setStrategy(_strategy);
+  }
+
+  if (closed && ind < _out.size()) {
+    char cid[1000];
+    sprintf(cid, "%s-%d", _id.c_str(), ind+1);
+    createChild(cid, _out[ind]);
+    return SPLIT;
+  }
+
+  return closed ? CLOSED : OPEN;
+}
+
+
 void AnalyticTableau::createChild(const string& id, SignedFormula *fml)
 {
   _children.push_back(new AnalyticTableau(id, fml, this));
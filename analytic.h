@@ -93,8 +93,6 @@ class AnalyticTableau : public Tableau
   // Sets the strategy object.
   virtual void setStrategy(AnalyticStrategy *strategy);
 
-  bool close();
-
  protected:  
   enum enumRule {A_E_NOT_OR=0, A_E_NOT_ORN,
 		 A_E_AND, A_E_ANDN,
@@ -106,15 +104,23 @@ class AnalyticTableau : public Tableau
   bool applyRule(AnalyticTableau::enumRule r,
 		 vector<SignedFormula *>& in, vector<SignedFormula *>& out);
 
+  virtual Step expand();
+  virtual Step resume(bool closed);
+
   // Create a child tableau
   virtual void createChild(const string& id, SignedFormula *fml);
 
-  // Auxiliary vectors containing the alpha, the beta formulas and the
-  // literals in vector _items.
-  vector<SignedFormula *> _alphas, _betas, _lits;
+  // The alpha, the beta formulas and the literals of the branch, kept
+  // in _branch and shared with the parent and the children.
+  vector<SignedFormula *> &_alphas, &_betas, &_lits;
 
   // Indicates if the tableau is closed
   bool _closed;
+
+  // The conclusions of the beta rule applied in the node, one for
+  // each child, and the mark of the branch state before the children.
+  vector<SignedFormula *> _out;
+  unsigned int _mark;
   
  private:
   // Strategy object
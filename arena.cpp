@@ -0,0 +1,208 @@
+/*****************************************************************************
+ * arena.cpp
+ *
+ * Definitions for the arena allocator.
+ *****************************************************************************/
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+#include <cassert>
+
+#include "arena.h"
+
+
+// Alignment of the objects allocated in an arena.
+static const size_t ALIGN = alignof(max_align_t);
+
+// Source of the serials of the arenas.
+static atomic<unsigned long> s_serial(1);
+
+// The current arena of the thread.
+static thread_local Arena *t_current = NULL;
+
+// The chunks the thread is allocating from, one in each of the last
+// arenas it used, the most recent first: the serial of the chunk, and
+// the free space left in it. A thread that switches between arenas
+// keeps filling its chunks instead of starting new ones.
+struct ThreadChunk
+{
+  unsigned long serial;
+  char *ptr, *end;
+};
+static const unsigned int THREAD_CHUNKS = 8;
+static thread_local vector<ThreadChunk> t_chunks;
+
+// The chunks of the arenas are aligned to slots of SLOT bytes, and
+// take whole slots, so the memory of any arena can be told from the
+// heap without a lock: a map of two levels, like the page map of a
+// malloc, marks the slots of the chunks. The leaves are built when
+// first needed and never freed. The addresses have at most 48 bits.
+static const unsigned int SLOT_BITS = 16, LEAF_BITS = 16;
+static const size_t SLOT = (size_t) 1 << SLOT_BITS;
+static const uintptr_t LEAVES = (uintptr_t) 1 << (48 - SLOT_BITS - LEAF_BITS);
+static atomic<atomic<bool> *> s_slots[LEAVES];
+
+// Marks the slots of the chunk of size bytes at p as taken or not.
+static void markSlots(const char *p, size_t size, bool taken)
+{
+  for (uintptr_t s = (uintptr_t) p >> SLOT_BITS;
+       s < ((uintptr_t) p + size) >> SLOT_BITS; s++) {
+    assert((s >> LEAF_BITS) < LEAVES);
+    atomic<bool> *leaf = s_slots[s >> LEAF_BITS].load();
+    if (leaf == NULL) {
+      atomic<bool> *fresh = new atomic<bool>[(size_t) 1 << LEAF_BITS]();
+      if (s_slots[s >> LEAF_BITS].compare_exchange_strong(leaf, fresh))
+	leaf = fresh;
+      else
+	delete[] fresh;
+    }
+    leaf[s & (((uintptr_t) 1 << LEAF_BITS) - 1)].store(taken);
+  }
+}
+
+// Returns true if p is in a slot of a chunk.
+static bool inSlots(const void *p)
+{
+  uintptr_t s = (uintptr_t) p >> SLOT_BITS;
+  if ((s >> LEAF_BITS) >= LEAVES)
+    return false;
+  atomic<bool> *leaf = s_slots[s >> LEAF_BITS].load(memory_order_acquire);
+  return leaf != NULL &&
+    leaf[s & (((uintptr_t) 1 << LEAF_BITS) - 1)].load(memory_order_acquire);
+}
+
+// Returns the chunk of the calling thread with serial, making it the
+// most recent. A new one (empty) replaces the least recently used.
+static ThreadChunk& threadChunk(unsigned long serial)
+{
+  vector<ThreadChunk>& chunks = t_chunks;
+  unsigned int i = 0;
+  while (i < chunks.size() && chunks[i].serial != serial)
+    i++;
+  if (i == chunks.size()) {
+    if (chunks.size() < THREAD_CHUNKS)
+      chunks.push_back(ThreadChunk());
+    i = chunks.size() - 1;
+    chunks[i].serial = serial;
+    chunks[i].ptr = chunks[i].end = NULL;
+  }
+  rotate(chunks.begin(), chunks.begin() + i, chunks.begin() + i + 1);
+  return chunks[0];
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+// Members of class Arena.
+//////////////////////////////////////////////////////////////////////////////
+
+Arena::Arena(size_t chunkSize)
+{
+  _chunkSize = chunkSize;
+  _serial = s_serial++;
+  _bytes = 0;
+  _allocations = 0;
+}
+
+Arena::~Arena() { release(); }
+
+void *Arena::allocate(size_t size)
+{
+  size = (size + ALIGN - 1) & ~(ALIGN - 1);
+  _allocations.fetch_add(1, memory_order_relaxed);
+
+  // Large objects get their own chunk
+  if (size > _chunkSize / 4)
+    return newChunk(size);
+
+  ThreadChunk& chunk = threadChunk(_serial);
+  if ((size_t) (chunk.end - chunk.ptr) < size) {
+    chunk.ptr = newChunk(_chunkSize);
+    chunk.end = chunk.ptr + _chunkSize;
+  }
+
+  void *p = chunk.ptr;
+  chunk.ptr += size;
+  return p;
+}
+
+void Arena::finalize(void *p, void (*finalizer)(void *))
+{
+  lock_guard<mutex> guard(_mutex);
+  _finalizers.push_back(make_pair(p, finalizer));
+}
+
+void Arena::release()
+{
+  lock_guard<mutex> guard(_mutex);
+
+  for (unsigned int i = _finalizers.size(); i > 0; i--)
+    _finalizers[i-1].second(_finalizers[i-1].first);
+  _finalizers.clear();
+
+  for (unsigned int i = 0; i < _chunks.size(); i++) {
+    markSlots(_chunks[i].first, _chunks[i].second, false);
+    free(_chunks[i].first);
+  }
+  _chunks.clear();
+  _bytes = 0;
+  _allocations = 0;
+
+  // The chunks of the threads are gone
+  _serial = s_serial++;
+}
+
+bool Arena::owns(const void *p) const
+{
+  lock_guard<mutex> guard(_mutex);
+  const char *c = (const char *) p;
+  for (unsigned int i = 0; i < _chunks.size(); i++)
+    if (c >= _chunks[i].first && c < _chunks[i].first + _chunks[i].second)
+      return true;
+  return false;
+}
+
+size_t Arena::bytes() const
+{
+  lock_guard<mutex> guard(_mutex);
+  return _bytes;
+}
+
+char *Arena::newChunk(size_t size)
+{
+  size = (size + SLOT - 1) & ~(SLOT - 1);
+  void *p;
+  if (posix_memalign(&p, SLOT, size) != 0)
+    throw bad_alloc();
+  char *chunk = (char *) p;
+  markSlots(chunk, size, true);
+
+  lock_guard<mutex> guard(_mutex);
+  _chunks.push_back(make_pair(chunk, size));
+  _bytes += size;
+  return chunk;
+}
+
+Arena *Arena::current() { return t_current; }
+
+void Arena::setCurrent(Arena *arena) { t_current = arena; }
+
+void *Arena::alloc(size_t size, void (*finalizer)(void *))
+{
+  if (t_current == NULL)
+    return ::operator new(size);
+
+  void *p = t_current->allocate(size);
+  if (finalizer != NULL)
+    t_current->finalize(p, finalizer);
+  return p;
+}
+
+void Arena::dealloc(void *p)
+{
+  if (! inSlots(p))
+    ::operator delete(p);
+}
@@ -0,0 +1,110 @@
+/*****************************************************************************
+ * arena.h
+ *
+ * Class declarations for the arena allocator.
+ *****************************************************************************/
+
+#ifndef __ARENA_H__
+#define __ARENA_H__
+
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+
+//////////////////////////////////////////////////////////////////////////////
+// Encapsulates an arena: objects are allocated by bumping a pointer in
+// large chunks of memory, and released all at once. Each thread
+// allocates from its own chunk, so several threads may share an
+// arena, and a thread keeps its chunk in each of the last arenas it
+// used.
+//
+// The classes allocated in arenas (Formula, SignedFormula and Tableau)
+// define operator new with alloc(), which uses the current arena of
+// the calling thread, or the heap if there is none. Objects allocated
+// in an arena must not be deleted: release() runs the finalizers
+// registered for them and frees the memory.
+//////////////////////////////////////////////////////////////////////////////
+
+class Arena
+{
+ public:
+  Arena(size_t chunkSize = 65536);
+  ~Arena();
+
+  // Returns size bytes of memory of the arena.
+  void *allocate(size_t size);
+
+  // Registers finalizer to be called with p by release(). Finalizers
+  // are called in the reverse order of their registration.
+  void finalize(void *p, void (*finalizer)(void *));
+
+  // Calls the finalizers and frees all the memory of the arena.
+  void release();
+
+  // Returns true if p points to memory of the arena.
+  bool owns(const void *p) const;
+
+  // Returns the number of bytes of memory held by the arena.
+  size_t bytes() const;
+
+  // Returns the number of objects allocated in the arena.
+  unsigned long allocations() const { return _allocations.load(); }
+
+  // Returns the current arena of the calling thread, or NULL.
+  static Arena *current();
+
+  // Sets the current arena of the calling thread (NULL for the heap).
+  static void setCurrent(Arena *arena);
+
+  // Allocates size bytes in the current arena, registering finalizer
+  // (if not NULL), or in the heap if there is no current arena.
+  static void *alloc(size_t size, void (*finalizer)(void *) = NULL);
+
+  // Frees memory allocated by alloc(), unless it belongs to an arena
+  // (not necessarily the current one).
+  static void dealloc(void *p);
+
+ private:
+  Arena(const Arena&);
+  Arena& operator=(const Arena&);
+
+  // Allocates a chunk of size bytes.
+  char *newChunk(size_t size);
+
+  size_t _chunkSize;
+
+  // Identifies the chunks handed out to the threads since the last
+  // release(). It is unique among all the arenas.
+  unsigned long _serial;
+
+  // Chunks (address and size) and finalizers, guarded by _mutex.
+  vector<pair<char *, size_t> > _chunks;
+  vector<pair<void *, void (*)(void *)> > _finalizers;
+  size_t _bytes;
+  mutable mutex _mutex;
+
+  atomic<unsigned long> _allocations;
+};
+
+
+//////////////////////////////////////////////////////////////////////////////
+// Sets the current arena of the calling thread while in scope.
+//////////////////////////////////////////////////////////////////////////////
+
+class ArenaScope
+{
+ public:
+  ArenaScope(Arena *arena) : _previous(Arena::current())
+  { Arena::setCurrent(arena); }
+  ~ArenaScope() { Arena::setCurrent(_previous); }
+
+ private:
+  Arena *_previous;
+};
+
+#endif
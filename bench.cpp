@@ -0,0 +1,483 @@
+// bench: measures prove on the cases and on the generated families of
+// theorems, and compares the results with a baseline.
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <iostream>
+
+#include <dirent.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace std;
+
+//
+// Usage: bench [-f family[:n],...] [-n N] [-c dir] [-m method,...]
+//              [-r R] [-w W] [-t seconds] [-d dir] [-o file]
+//              [-b baseline] [-x percent]
+//
+// Generates the families php, h, gamma and statman (by default) from
+// 1 to N (5 by default), or to n for a family given as family:n, in
+// the directory -d (bench.d by default), with the generators of the
+// current directory. Then runs ./prove with each method (all of them
+// by default) on every generated file and on every .prove file of the
+// directory -c (cases by default; -c "" skips it).
+//
+// Each proof is run W times to warm up (1 by default) and R times to
+// be measured (5 by default), giving up after the seconds of -t (10 by
+// default). A line of CSV is written for each file and method: the
+// status (closed, open or unknown), the median and the 95th
+// percentile of the total time of the proof reported by prove (its
+// setup and init included), the median wall time of the process, the
+// nodes, the formulae and the peak resident set size. -o writes the lines to a file too, to be used later as a
+// baseline.
+//
+// -b compares the results with a baseline written by -o. A proof
+// regresses if its status or its nodes change, or if its median
+// time, its wall time or its peak memory grow more than the percent
+// of -x (10 by default), and the time more than a millisecond or the
+// wall time, which starting the process makes noisier, more than 10
+// milliseconds. The regressions are written
+// to cerr, and bench exits with 2 if there is any.
+//
+
+void usage()
+{
+  cout << "Usage: bench [-f family[:n],...] [-n N] [-c dir] [-m method,...] [-r R] [-w W] [-t seconds] [-d dir] [-o file] [-b baseline] [-x percent]" << endl;
+  return;
+}
+
+
+// Options of the benchmark.
+struct Options
+{
+  // The families to generate, with their largest n.
+  vector<pair<string, int> > families;
+  vector<string> methods;
+  string cases, dir, output, baseline;
+  int reps, warmup;
+  double timeout, threshold;
+};
+
+
+// The measures of a file proved with a method.
+struct Result
+{
+  string file, method, status;
+  double median, p95, wall;
+  unsigned long nodes, formulae;
+  long rssKB;
+};
+
+
+// Splits list at the commas.
+static vector<string> split(const string& list)
+{
+  vector<string> v;
+  size_t start = 0, comma;
+  do {
+    comma = list.find(',', start);
+    v.push_back(list.substr(start, comma == string::npos ?
+			    string::npos : comma - start));
+    start = comma + 1;
+  } while (comma != string::npos);
+  return v;
+}
+
+
+// Runs the program args[0] with the arguments args in the directory
+// dir (the current one if empty), putting its output in out, the wall
+// time it took in wall and its peak resident set size in rssKB.
+// Returns false if it cannot be run or does not exit with 0.
+static bool run(const vector<string>& args, const string& dir,
+		string& out, double& wall, long& rssKB)
+{
+  int fds[2];
+  if (pipe(fds) == -1)
+    return false;
+
+  struct timeval startt, endt;
+  gettimeofday(&startt, NULL);
+
+  pid_t pid = fork();
+  if (pid == -1) {
+    close(fds[0]);
+    close(fds[1]);
+    return false;
+  }
+  if (pid == 0) {
+    vector<char *> argv;
+    for (unsigned int i = 0; i < args.size(); i++)
+      argv.push_back((char *) args[i].c_str());
+    argv.push_back(NULL);
+
+    dup2(fds[1], STDOUT_FILENO);
+    close(fds[0]);
+    close(fds[1]);
+    if (! dir.empty() && chdir(dir.c_str()) == -1)
+      _exit(127);
+    execv(argv[0], &argv[0]);
+    _exit(127);
+  }
+
+  close(fds[1]);
+  out.clear();
+  char buf[4096];
+  ssize_t n;
+  while ((n = read(fds[0], buf, sizeof(buf))) > 0)
+    out.append(buf, n);
+  close(fds[0]);
+
+  int status;
+  struct rusage usage;
+  if (wait4(pid, &status, 0, &usage) == -1)
+    return false;
+  gettimeofday(&endt, NULL);
+
+  wall = (endt.tv_sec - startt.tv_sec) +
+    (endt.tv_usec - startt.tv_usec) * 1e-6;
+  rssKB = usage.ru_maxrss;
+  return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+}
+
+
+// Puts in fields the fields of the CSV record written by prove -s csv,
+// by the names of its header. Returns false if there is no record.
+static bool readRecord(const string& out, map<string, string>& fields)
+{
+  istringstream in(out);
+  string header, record;
+  if (! getline(in, header) || ! getline(in, record))
+    return false;
+
+  vector<string> names = split(header), values = split(record);
+  if (names.size() != values.size())
+    return false;
+  for (unsigned int i = 0; i < names.size(); i++)
+    fields[names[i]] = values[i];
+  return true;
+}
+
+
+// Returns the p'th percentile of the sorted values v, by nearest rank.
+static double percentile(const vector<double>& v, double p)
+{
+  unsigned int rank = (unsigned int) (p * v.size() + 0.999999);
+  return v[rank > 0 ? rank - 1 : 0];
+}
+
+// Returns the median of the sorted values v.
+static double median(const vector<double>& v)
+{
+  unsigned int n = v.size();
+  return n % 2 ? v[n / 2] : (v[n / 2 - 1] + v[n / 2]) / 2;
+}
+
+
+// Proves file with method as set by opts, filling result. Returns
+// false if prove fails.
+static bool measure(const string& file, const string& method,
+		    const Options& opts, Result& result)
+{
+  char limit[40];
+  snprintf(limit, sizeof(limit), "s=%g", opts.timeout);
+
+  vector<string> args;
+  args.push_back("./prove");
+  args.push_back("-s");
+  args.push_back("csv");
+  args.push_back("-L");
+  args.push_back(limit);
+  args.push_back("-m");
+  args.push_back(method);
+  args.push_back("-f");
+  args.push_back(file);
+
+  vector<double> times, walls;
+  result.file = file;
+  result.method = method;
+  result.rssKB = 0;
+  for (int i = 0; i < opts.warmup + opts.reps; i++) {
+    string out;
+    double wall;
+    long rssKB;
+    map<string, string> fields;
+    if (! run(args, "", out, wall, rssKB) || ! readRecord(out, fields))
+      return false;
+    if (i < opts.warmup)
+      continue;
+
+    times.push_back(atof(fields["total"].c_str()));
+    walls.push_back(wall);
+    result.status = fields["status"];
+    result.nodes = strtoul(fields["nodes"].c_str(), NULL, 10);
+    result.formulae = strtoul(fields["formulae"].c_str(), NULL, 10);
+    result.rssKB = max(result.rssKB, rssKB);
+  }
+
+  sort(times.begin(), times.end());
+  sort(walls.begin(), walls.end());
+  result.median = median(times);
+  result.p95 = percentile(times, 0.95);
+  result.wall = median(walls);
+  return true;
+}
+
+
+// Writes the results in CSV format.
+static void writeHeader(ostream& out)
+{
+  out << "file,method,status,median_s,p95_s,wall_s,nodes,formulae,rss_kb"
+      << endl;
+}
+
+static void writeResult(ostream& out, const Result& r)
+{
+  char times[80];
+  snprintf(times, sizeof(times), "%.6f,%.6f,%.6f", r.median, r.p95, r.wall);
+  out << r.file << "," << r.method << "," << r.status << "," << times << ","
+      << r.nodes << "," << r.formulae << "," << r.rssKB << endl;
+}
+
+
+// Reads the results written to file by -o, by file and method.
+// Returns false if file cannot be read.
+static bool readBaseline(const string& file,
+			 map<pair<string, string>, Result>& baseline)
+{
+  ifstream in(file.c_str());
+  if (! in)
+    return false;
+
+  string line;
+  getline(in, line); // header
+  while (getline(in, line)) {
+    vector<string> f = split(line);
+    if (f.size() != 9)
+      continue;
+    Result r;
+    r.file = f[0];
+    r.method = f[1];
+    r.status = f[2];
+    r.median = atof(f[3].c_str());
+    r.p95 = atof(f[4].c_str());
+    r.wall = atof(f[5].c_str());
+    r.nodes = strtoul(f[6].c_str(), NULL, 10);
+    r.formulae = strtoul(f[7].c_str(), NULL, 10);
+    r.rssKB = atol(f[8].c_str());
+    baseline[make_pair(r.file, r.method)] = r;
+  }
+  return true;
+}
+
+
+// Writes to cerr how r regresses from its baseline b, if it does.
+// Returns true if it does.
+static bool regresses(const Result& r, const Result& b, double threshold)
+{
+  double factor = 1 + threshold / 100;
+  ostringstream why;
+  if (r.status != b.status)
+    why << " status " << b.status << " -> " << r.status;
+  if (r.nodes != b.nodes)
+    why << " nodes " << b.nodes << " -> " << r.nodes;
+  if (r.median > b.median * factor && r.median - b.median > 0.001)
+    why << " time " << b.median << " -> " << r.median;
+  if (r.wall > b.wall * factor && r.wall - b.wall > 0.010)
+    why << " wall " << b.wall << " -> " << r.wall;
+  if (r.rssKB > b.rssKB * factor)
+    why << " rss_kb " << b.rssKB << " -> " << r.rssKB;
+
+  if (why.str().empty())
+    return false;
+  cerr << "REGRESSION " << r.file << " " << r.method << ":" << why.str()
+       << endl;
+  return true;
+}
+
+
+// Appends to files the .prove files of dir, in order. Returns false if
+// dir cannot be read.
+static bool listCases(const string& dir, vector<string>& files)
+{
+  DIR *d = opendir(dir.c_str());
+  if (d == NULL)
+    return false;
+
+  vector<string> cases;
+  struct dirent *entry;
+  while ((entry = readdir(d)) != NULL) {
+    string name = entry->d_name;
+    if (name.size() > 6 && name.compare(name.size() - 6, 6, ".prove") == 0)
+      cases.push_back(dir + "/" + name);
+  }
+  closedir(d);
+
+  sort(cases.begin(), cases.end());
+  files.insert(files.end(), cases.begin(), cases.end());
+  return true;
+}
+
+
+// Generates the family from 1 to n in opts.dir, appending the files
+// to files. Returns false if the generator fails.
+static bool generate(const string& family, int n, const Options& opts,
+		     vector<string>& files)
+{
+  char to[20];
+  snprintf(to, sizeof(to), "%d", n);
+
+  // The generator runs in the directory of the files
+  char cwd[4096];
+  if (getcwd(cwd, sizeof(cwd)) == NULL)
+    return false;
+  vector<string> args;
+  args.push_back(string(cwd) + "/" + family);
+  args.push_back("-from");
+  args.push_back("1");
+  args.push_back("-to");
+  args.push_back(to);
+
+  string out;
+  double wall;
+  long rssKB;
+  if (! run(args, opts.dir, out, wall, rssKB))
+    return false;
+
+  for (int i = 1; i <= n; i++) {
+    char file[40];
+    snprintf(file, sizeof(file), "%s%d.prove", family.c_str(), i);
+    files.push_back(opts.dir + "/" + file);
+  }
+  return true;
+}
+
+
+int main(int argc, char **argv)
+{
+  bool syntax = false;
+  int arg, n = 5;
+  vector<string> families;
+  Options opts;
+  opts.cases = "cases";
+  opts.dir = "bench.d";
+  opts.reps = 5;
+  opts.warmup = 1;
+  opts.timeout = 10;
+  opts.threshold = 10;
+  families = split("php,h,gamma,statman");
+  opts.methods = split("analytic,analytic+BU,ke,ke+V,ke+P,kes3,kes3+PB");
+
+  for (arg = 1; ! syntax && arg < argc; arg++) {
+    // Every option has a value
+    if (arg+1 == argc || argv[arg][0] != '-' || strlen(argv[arg]) != 2) {
+      syntax = true;
+      break;
+    }
+    const char *value = argv[++arg];
+
+    switch (argv[arg-1][1]) {
+    case 'f': families = split(value); break;
+    case 'n': n = atoi(value); syntax = n < 1; break;
+    case 'c': opts.cases = value; break;
+    case 'm': opts.methods = split(value); break;
+    case 'r': opts.reps = atoi(value); syntax = opts.reps < 1; break;
+    case 'w': opts.warmup = atoi(value); syntax = opts.warmup < 0; break;
+    case 't': opts.timeout = atof(value); syntax = opts.timeout <= 0; break;
+    case 'd': opts.dir = value; break;
+    case 'o': opts.output = value; break;
+    case 'b': opts.baseline = value; break;
+    case 'x':
+      opts.threshold = atof(value);
+      syntax = opts.threshold < 0;
+      break;
+    default: syntax = true;
+    }
+  }
+
+  for (unsigned int i = 0; ! syntax && i < families.size(); i++) {
+    string family = families[i];
+    int to = n;
+    size_t colon = family.find(':');
+    if (colon != string::npos) {
+      to = atoi(family.c_str() + colon + 1);
+      family.erase(colon);
+    }
+    if (family != "php" && family != "h" && family != "gamma" &&
+	family != "statman")
+      syntax = true;
+    else if (to > 0)
+      opts.families.push_back(make_pair(family, to));
+  }
+
+  if (syntax) {
+    usage();
+    return 1;
+  }
+
+  map<pair<string, string>, Result> baseline;
+  if (! opts.baseline.empty() && ! readBaseline(opts.baseline, baseline)) {
+    cerr << "bench: cannot read " << opts.baseline << endl;
+    return 1;
+  }
+
+  vector<string> files;
+  if (! opts.cases.empty() && ! listCases(opts.cases, files)) {
+    cerr << "bench: cannot read " << opts.cases << endl;
+    return 1;
+  }
+  mkdir(opts.dir.c_str(), 0777);
+  for (unsigned int i = 0; i < opts.families.size(); i++)
+    if (! generate(opts.families[i].first, opts.families[i].second,
+		   opts, files)) {
+      cerr << "bench: cannot generate " << opts.families[i].first << endl;
+      return 1;
+    }
+
+  ofstream output;
+  if (! opts.output.empty()) {
+    output.open(opts.output.c_str());
+    if (! output) {
+      cerr << "bench: cannot write " << opts.output << endl;
+      return 1;
+    }
+    writeHeader(output);
+  }
+  writeHeader(cout);
+
+  int regressions = 0;
+  for (unsigned int f = 0; f < files.size(); f++)
+    for (unsigned int m = 0; m < opts.methods.size(); m++) {
+      Result r;
+      if (! measure(files[f], opts.methods[m], opts, r)) {
+	cerr << "bench: prove failed on " << files[f] << " "
+	     << opts.methods[m] << endl;
+	continue;
+      }
+      writeResult(cout, r);
+      if (output.is_open())
+	writeResult(output, r);
+
+      map<pair<string, string>, Result>::iterator b =
+	baseline.find(make_pair(r.file, r.method));
+      if (b != baseline.end() && regresses(r, b->second, opts.threshold))
+	regressions++;
+    }
+
+  if (regressions > 0) {
+    cerr << regressions << " regressions" << endl;
+    return 2;
+  }
+  return 0;
+}
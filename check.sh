@@ -0,0 +1,169 @@
+#!/bin/sh
+#
+# check.sh: checks that the options of prove do not change its
+# results. Proves random problems (see random.cpp) with the analytic
+# method, taken as the reference, and with the other methods under
+# each set of options, and reports every problem on which they differ.
+# Then checks that the readers reject malformed files.
+#
+# Usage: check.sh [problems [size]]
+#
+# Exits with 1 if any check fails.
+#
+
+N=${1:-1000}
+SIZE=${2:-20}
+DIR=check.d
+
+rm -rf $DIR
+mkdir $DIR
+(cd $DIR && ../random -from 1 -to $N -atoms 6 -size $SIZE) || exit 1
+ls $DIR/*.prove > $DIR/list
+
+# Writes the file and the status of each proof with method and the
+# options, sorted by file.
+status()
+{
+  method=$1
+  shift
+  ./prove "$@" -s csv -m $method -F $DIR/list | tail -n +2 | cut -d, -f1,3 |
+    sort
+}
+
+status analytic > $DIR/reference
+failed=0
+
+# Compares the results of method with the options to the reference.
+compare()
+{
+  status "$@" > $DIR/result
+  if ! diff $DIR/reference $DIR/result > $DIR/diff; then
+    echo "FAIL: $*"
+    grep '^>' $DIR/diff | head -5
+    failed=1
+  else
+    echo "ok: $*"
+  fi
+}
+
+for method in analytic+BU ke ke+V ke+P kes3 kes3+PB; do
+  compare $method
+done
+for method in ke ke+V ke+P; do
+  compare $method -l
+  compare $method -b
+  compare $method -l -b
+done
+for policy in lru fifo replace; do
+  compare ke -t 1 -e $policy
+  compare ke+P -t 1 -e $policy -l -b
+done
+
+# In batch mode, -j runs the proofs in parallel, and the portfolio
+# races its methods.
+for jobs in 2 4; do
+  compare analytic -j $jobs
+  compare ke+P -j $jobs -l -b
+  compare portfolio -j $jobs
+done
+compare portfolio -p ke+V,kes3,analytic
+
+# A proof alone closes its tableau with -j threads, so every problem is
+# proved by itself, writing the same lines as status.
+single()
+{
+  method=$1
+  shift
+  for file in `cat $DIR/list`; do
+    ./prove "$@" -s csv -m $method -f $file | tail -n +2
+  done | cut -d, -f1,3 | sort
+}
+
+compare_single()
+{
+  single "$@" > $DIR/result
+  if ! diff $DIR/reference $DIR/result > $DIR/diff; then
+    echo "FAIL: -f $*"
+    grep '^>' $DIR/diff | head -5
+    failed=1
+  else
+    echo "ok: -f $*"
+  fi
+}
+
+for jobs in 2 4; do
+  for method in ke ke+V ke+P; do
+    compare_single $method -j $jobs
+    compare_single $method -j $jobs -l -b
+  done
+  compare_single ke -j $jobs -t 1 -e lru -l
+done
+
+# The proofs of a batch find the same tableaux as the proofs alone.
+./prove -s csv -m ke -m ke+P -F $DIR/list -j 4 | tail -n +2 |
+  cut -d, -f1,2,13,14 | sort > $DIR/batch
+for method in ke ke+P; do
+  for file in `cat $DIR/list`; do
+    ./prove -s csv -m $method -f $file | tail -n +2
+  done
+done | cut -d, -f1,2,13,14 | sort > $DIR/alone
+if ! diff $DIR/alone $DIR/batch > $DIR/diff; then
+  echo "FAIL: batch nodes"
+  grep '^>' $DIR/diff | head -5
+  failed=1
+else
+  echo "ok: batch nodes"
+fi
+
+# Checks that prove reads the file named name with the contents (a
+# printf format) with the exit status, and does not crash. The memory
+# is limited, so huge variables cannot be given room.
+read_file()
+{
+  expected=$1
+  name=$2
+  printf "$3" > $DIR/$name
+  (ulimit -v 1000000; ./prove -f $DIR/$name) > /dev/null 2> $DIR/error
+  status=$?
+  if [ $status != $expected ]; then
+    echo "FAIL: $name exits with $status"
+    cat $DIR/error
+    failed=1
+  else
+    echo "ok: $name"
+  fi
+}
+
+read_file 1 bad_literal.cnf 'p cnf 2 1\n1 x 0\n'
+read_file 1 bad_problem.cnf 'p cnf -2 1\n1 0\n'
+read_file 1 empty_clause.cnf 'p cnf 1 2\n1 0\n0\n'
+read_file 1 unterminated.cnf 'p cnf 2 1\n1 2\n'
+read_file 1 beyond_vars.cnf 'p cnf 3 1\n2147483647 0\n'
+read_file 1 overflow.cnf 'p cnf 2 1\n99999999999 0\n'
+read_file 0 huge_var.cnf '2147483647 -1 0\n'
+read_file 1 bad_sign.prove 'X(a&b)\n'
+read_file 1 bad_formula.prove 'T(a&\n'
+read_file 1 non_ascii.prove 'T(a&\351)\n'
+read_file 1 non_ascii_atom.prove 'T(a\377\200b)\n'
+read_file 1 empty.prove ''
+read_file 1 comments.cnf 'c no clauses\n'
+read_file 1 no_clauses.cnf 'p cnf 0 0\n'
+
+# An empty problem in a batch gives an error line, and the batch goes
+# on with the next file.
+printf "$DIR/empty.prove\n$DIR/huge_var.cnf\n" > $DIR/empty.list
+./prove -m ke -m analytic -F $DIR/empty.list -j 2 > $DIR/result 2> $DIR/error
+status=$?
+if [ $status != 0 ] || [ `grep -c ' error: ' $DIR/result` != 2 ] ||
+   [ `grep -c huge_var $DIR/result` != 2 ]; then
+  echo "FAIL: empty problem in a batch exits with $status"
+  cat $DIR/result $DIR/error
+  failed=1
+else
+  echo "ok: empty problem in a batch"
+fi
+
+if [ $failed = 0 ]; then
+  rm -rf $DIR
+fi
+exit $failed
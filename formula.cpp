@@ -5,8 +5,11 @@
  *
  */
 
+#include <algorithm>
+
 #include <cassert>
 #include <cctype>
+#include <climits>
 #include <stack>
 
 #include "formula.h"
@@ -14,8 +17,25 @@
 
 using namespace std;
 
+// Number of bits of the words of the atom bitsets.
+static const unsigned int WORD_BITS = sizeof(unsigned long) * CHAR_BIT;
+
 // Members of class Formula.
 
+struct Formula::Meta {
+  // Size of the formula, with and without atom ocurrences.
+  unsigned int size, ops;
+
+  // Atoms ocurring in the formula and their number of ocurrences,
+  // sorted by atom id.
+  vector<pair<unsigned int, unsigned int> > atoms;
+
+  // Atoms ocurring with positive and negative polarity. Bit b of
+  // word w stands for the atom (base + w) * WORD_BITS + b.
+  unsigned int base;
+  vector<unsigned long> pos, neg;
+};
+
 Formula::Formula(Formula::opType t, vector<Formula *>& vfml)
 {
   assert(t == ANDN || t == ORN);
@@ -25,6 +45,9 @@ Formula::Formula(Formula::opType t, vector<Formula *>& vfml)
   left = right = NULL;
   atom = "";
   fmls = vfml;
+  id = 0;
+  atomId = 0;
+  _meta = NULL;
 }
 
 Formula::Formula(Formula::opType t, Formula *l, Formula *r)
@@ -35,6 +58,9 @@ Formula::Formula(Formula::opType t, Formula *l, Formula *r)
   left = l;
   right = r;
   atom = "";
+  id = 0;
+  atomId = 0;
+  _meta = NULL;
 }
 
 Formula::Formula(Formula::opType t, Formula *r)
@@ -45,6 +71,9 @@ Formula::Formula(Formula::opType t, Formula *r)
   left = NULL;
   right = r;
   atom = "";
+  id = 0;
+  atomId = 0;
+  _meta = NULL;
 }
 
 Formula::Formula(const string& a)
@@ -52,6 +81,9 @@ Formula::Formula(const string& a)
   op = ATOM;
   left = right = NULL;
   atom = a;
+  id = 0;
+  atomId = 0;
+  _meta = NULL;
 }
 
 Formula::Formula(const Formula& rhs)
@@ -60,372 +92,640 @@ Formula::Formula(const Formula& rhs)
     return;
   
   op = rhs.op;
-  if (rhs.left)
-    left = new Formula(*(rhs.left));
-  else
-    left = NULL;
-  if (rhs.right)
-    right = new Formula(*(rhs.right));
-  else
-    right = NULL;
-
-  for (unsigned int i = 0; i < rhs.fmls.size(); i++)
-    fmls.push_back(new Formula(*(rhs.fmls[i])));
-
+  left = rhs.left;
+  right = rhs.right;
+  fmls = rhs.fmls;
   atom = rhs.atom;
+  atomId = rhs.atomId;
+  id = rhs.id;
+  _meta = NULL;
+
+  // The subformulas of each copied node still are those of rhs: they
+  // are replaced by copies, with an explicit stack.
+  vector<Formula *> pending(1, this);
+  while (! pending.empty()) {
+    Formula *f = pending.back();
+    pending.pop_back();
+    if (f->left) {
+      f->left = shallowCopy(f->left);
+      pending.push_back(f->left);
+    }
+    if (f->right) {
+      f->right = shallowCopy(f->right);
+      pending.push_back(f->right);
+    }
+    for (unsigned int i = 0; i < f->fmls.size(); i++) {
+      f->fmls[i] = shallowCopy(f->fmls[i]);
+      pending.push_back(f->fmls[i]);
+    }
+  }
 }
 
 Formula::~Formula()
 {
-  if (left)
-    delete left;
-  if (right)
-    delete right;
-  for (unsigned int i = 0; i < fmls.size(); i++)
-    delete fmls[i];
+  // The subformulas are detached before being deleted, so they are
+  // deleted with an explicit stack.
+  vector<Formula *> pending;
+  detach(pending);
+  while (! pending.empty()) {
+    Formula *f = pending.back();
+    pending.pop_back();
+    f->detach(pending);
+    delete f;
+  }
+  delete _meta.load();
 }
 
-string Formula::toString() const
+void Formula::finalize(void *p)
 {
-  string s;
-  switch (op) {
+  Formula *fml = (Formula *) p;
+  fml->left = fml->right = NULL;
+  fml->fmls.clear();
+  fml->~Formula();
+}
+
+Formula *Formula::shallowCopy(const Formula *fml)
+{
+  Formula *copy;
+  switch (fml->op) {
   case ATOM:
-    s = atom;
+    copy = new Formula(fml->atom);
     break;
   case NOT:
-    s = "(!" + right->toString() + ")";
+    copy = new Formula(fml->op, fml->right);
     break;
-  case OR:
-    s = "(" + left->toString() + "|" + right->toString() + ")";
-    break;
-  case AND:
-    s =  "(" + left->toString() + "&" + right->toString() + ")";
-    break;
-  case IMPLIES:
-    s = "(" + left->toString() + "->" + right->toString() + ")";
-    break;
-  case ANDN:
-    s = "(" + fmls[0]->toString();
-    for (unsigned int i = 1; i < fmls.size(); i++)
-      s += "&" + fmls[i]->toString();
-    s += ")";
-    break;
-  case ORN:
-    s = "(" + fmls[0]->toString();
-    for (unsigned int i = 1; i < fmls.size(); i++)
-      s += "|" + fmls[i]->toString();
-    s += ")";
+  case OR: case AND: case IMPLIES:
+    copy = new Formula(fml->op, fml->left, fml->right);
     break;
+  default:
+    {
+      vector<Formula *> vfml = fml->fmls;
+      copy = new Formula(fml->op, vfml);
+    }
   }
-  return s;
+  copy->atomId = fml->atomId;
+  copy->id = fml->id;
+  return copy;
 }
 
-unsigned int Formula::size(bool count_atoms) const
+void Formula::detach(vector<Formula *>& subs)
 {
-  switch (op) {
-  case ATOM:
-    if (count_atoms)
-      return 1;
-    else
-      return 0;
-  case NOT:
-    return 1 + right->size(count_atoms);
-  case OR: case AND: case IMPLIES:
-    return 1 + left->size(count_atoms) + right->size(count_atoms);
-  case ORN: case ANDN:
-    {
-      unsigned int sz = 1;
-      for (unsigned int i = 0; i < fmls.size(); i++)
-	sz += fmls[i]->size(count_atoms);
-      return sz;
+  if (left)
+    subs.push_back(left);
+  if (right)
+    subs.push_back(right);
+  subs.insert(subs.end(), fmls.begin(), fmls.end());
+  left = right = NULL;
+  fmls.clear();
+}
+
+void Formula::computeMeta(Meta& m) const
+{
+  m.size = m.ops = 0;
+  m.atoms.clear();
+
+  // Ocurrences of atoms, and whether they are negative
+  vector<pair<unsigned int, bool> > occ;
+  vector<pair<const Formula *, bool> > pending(1, make_pair(this, false));
+  while (! pending.empty()) {
+    const Formula *f = pending.back().first;
+    bool negative = pending.back().second;
+    pending.pop_back();
+
+    m.size++;
+    if (f->op != ATOM)
+      m.ops++;
+    switch (f->op) {
+    case ATOM:
+      occ.push_back(make_pair(f->atomId, negative));
+      break;
+    case NOT:
+      pending.push_back(make_pair(f->right, ! negative));
+      break;
+    case IMPLIES:
+      pending.push_back(make_pair(f->left, ! negative));
+      pending.push_back(make_pair(f->right, negative));
+      break;
+    case OR: case AND:
+      pending.push_back(make_pair(f->left, negative));
+      pending.push_back(make_pair(f->right, negative));
+      break;
+    case ORN: case ANDN:
+      for (unsigned int i = 0; i < f->fmls.size(); i++)
+	pending.push_back(make_pair(f->fmls[i], negative));
+      break;
     }
   }
 
-  return 0;
+  sort(occ.begin(), occ.end());
+  m.base = occ.empty() ? 0 : occ.front().first / WORD_BITS;
+  unsigned int words =
+    occ.empty() ? 0 : occ.back().first / WORD_BITS - m.base + 1;
+  m.pos.assign(words, 0);
+  m.neg.assign(words, 0);
+  for (unsigned int i = 0; i < occ.size(); i++) {
+    unsigned int a = occ[i].first;
+    if (m.atoms.empty() || m.atoms.back().first != a)
+      m.atoms.push_back(make_pair(a, 0));
+    m.atoms.back().second++;
+    unsigned long bit = 1UL << (a % WORD_BITS);
+    if (occ[i].second)
+      m.neg[a / WORD_BITS - m.base] |= bit;
+    else
+      m.pos[a / WORD_BITS - m.base] |= bit;
+  }
 }
 
-int Formula::value(map<string, int>& valuation) const
+const Formula::Meta *Formula::meta(Meta& scratch) const
 {
-  switch (op) {
-  case ATOM:
-    {
-      if (valuation.find(atom) == valuation.end())
-	return -1;
-      else
-	return valuation[atom];
+  // Non-canonical formulas may be modified, so they are not cached
+  if (id == 0) {
+    computeMeta(scratch);
+    return &scratch;
+  }
+
+  Meta *m = _meta.load();
+  if (m != NULL)
+    return m;
+
+  m = new Meta;
+  computeMeta(*m);
+
+  // Another thread may have computed it meanwhile
+  Meta *expected = NULL;
+  if (! _meta.compare_exchange_strong(expected, m)) {
+    delete m;
+    m = expected;
+  }
+  return m;
+}
+
+string Formula::toString() const
+{
+  // Pending formulas and tokens (formula NULL), in reverse order
+  vector<pair<const Formula *, const char *> > pending;
+  pending.push_back(make_pair(this, (const char *) NULL));
+
+  string s;
+  while (! pending.empty()) {
+    const Formula *f = pending.back().first;
+    const char *token = pending.back().second;
+    pending.pop_back();
+
+    if (f == NULL) {
+      s += token;
+      continue;
+    }
+
+    const char *opstr = NULL;
+    switch (f->op) {
+    case ATOM:
+      s += f->atom;
+      break;
+    case NOT:
+      s += "(!";
+      pending.push_back(make_pair((const Formula *) NULL, ")"));
+      pending.push_back(make_pair(f->right, (const char *) NULL));
+      break;
+    case OR:
+      opstr = "|";
+      break;
+    case AND:
+      opstr = "&";
+      break;
+    case IMPLIES:
+      opstr = "->";
+      break;
+    case ANDN:
+      opstr = "&";
+      break;
+    case ORN:
+      opstr = "|";
+      break;
+    }
+    if (opstr == NULL)
+      continue;
+
+    vector<Formula *> subs;
+    if (f->op == ANDN || f->op == ORN)
+      subs = f->fmls;
+    else {
+      subs.push_back(f->left);
+      subs.push_back(f->right);
+    }
+    s += "(";
+    pending.push_back(make_pair((const Formula *) NULL, ")"));
+    for (unsigned int i = subs.size(); i > 0; i--) {
+      pending.push_back(make_pair(subs[i-1], (const char *) NULL));
+      if (i > 1)
+	pending.push_back(make_pair((const Formula *) NULL, opstr));
     }
-    break;
-  case NOT:
-    {
-      int valr = right->value(valuation);
-      if (valr == -1)
-	return -1;
+  }
+  return s;
+}
+
+unsigned int Formula::size(bool count_atoms) const
+{
+  Meta scratch;
+  const Meta *m = meta(scratch);
+  return count_atoms ? m->size : m->ops;
+}
+
+int Formula::value(const vector<int>& valuation) const
+{
+  // Postorder traversal: when a formula is visited the second time,
+  // the values of its subformulas are on top of values.
+  vector<pair<const Formula *, bool> > pending(1, make_pair(this, false));
+  vector<int> values;
+  while (! pending.empty()) {
+    const Formula *f = pending.back().first;
+
+    if (f->op == ATOM) {
+      pending.pop_back();
+      if (f->atomId >= valuation.size())
+	values.push_back(-1);
       else
-	return (valr ? 0 : 1);
-    }
-    break;
-  case OR:
-    {
-      int vl, vr;
-      vl = left->value(valuation);
-      vr = right->value(valuation);
-      if (vl == 1 || vr == 1) return 1;
-      if (vl == 0 && vr == 0) return 0;
-      return -1;
-    }
-    break;
-  case AND:
-    {
-      int vl, vr;
-      vl = left->value(valuation);
-      vr = right->value(valuation);
-      if (vl == 0 || vr == 0) return 0;
-      if (vl == 1 && vr == 1) return 1;
-      return -1;
-    }
-    break;
-  case IMPLIES:
-    {
-      int vl, vr;
-      vl = left->value(valuation);
-      vr = right->value(valuation);
-      if (vl == 0 || vr == 1) return 1;
-      if (vl == 1 && vr == 0) return 0;
-      return -1;
-    }
-    break;
-  case ORN:
-    {
-      unsigned int j, cu = 0, ct = 0, cf = 0;
-      for (j = 0; j < fmls.size(); j++) {
-	int vj = fmls[j]->value(valuation);
-	if (vj == -1) cu++;
-	else if (vj == 0) cf++;
-	else ct++;
+	values.push_back(valuation[f->atomId]);
+      continue;
+    }
+
+    if (! pending.back().second) {
+      pending.back().second = true;
+      if (f->op == NOT)
+	pending.push_back(make_pair(f->right, false));
+      else if (f->op == ORN || f->op == ANDN)
+	for (unsigned int i = f->fmls.size(); i > 0; i--)
+	  pending.push_back(make_pair(f->fmls[i-1], false));
+      else {
+	pending.push_back(make_pair(f->right, false));
+	pending.push_back(make_pair(f->left, false));
       }
-      if (ct > 0) return 1;
-      if (cf == fmls.size()) return 0;
-      return -1;
-    }
-  case ANDN:
-    {
-      unsigned int j, cu = 0, ct = 0, cf = 0;
-      for (j = 0; j < fmls.size(); j++) {
-	int vj = fmls[j]->value(valuation);
-	if (vj == -1) cu++;
-	else if (vj == 0) cf++;
-	else ct++;
+      continue;
+    }
+    pending.pop_back();
+
+    int val = -1;
+    switch (f->op) {
+    case NOT:
+      {
+	int valr = values.back();
+	values.pop_back();
+	if (valr != -1)
+	  val = (valr ? 0 : 1);
+      }
+      break;
+    case IMPLIES:
+      {
+	int vr = values.back();
+	values.pop_back();
+	int vl = values.back();
+	values.pop_back();
+	if (vl == 0 || vr == 1) val = 1;
+	else if (vl == 1 && vr == 0) val = 0;
       }
-      if (cf > 0) return 0;
-      if (ct == fmls.size()) return 1;
-      return -1;
+      break;
+    case OR: case ORN: case AND: case ANDN:
+      {
+	unsigned int n = (f->op == OR || f->op == AND) ? 2 : f->fmls.size();
+	unsigned int j, ct = 0, cf = 0;
+	for (j = 0; j < n; j++) {
+	  int vj = values.back();
+	  values.pop_back();
+	  if (vj == 0) cf++;
+	  else if (vj == 1) ct++;
+	}
+	if (f->op == OR || f->op == ORN) {
+	  if (ct > 0) val = 1;
+	  else if (cf == n) val = 0;
+	}
+	else {
+	  if (cf > 0) val = 0;
+	  else if (ct == n) val = 1;
+	}
+      }
+      break;
+    default:
+      break;
     }
+    values.push_back(val);
   }
+  return values.back();
+}
+
+int Formula::polarity(unsigned int str) const
+{
+  Meta scratch;
+  const Meta *m = meta(scratch);
+  unsigned int w = str / WORD_BITS;
+  if (w < m->base || w - m->base >= m->pos.size())
+    return -1;
+  unsigned long bit = 1UL << (str % WORD_BITS);
+  bool pos = m->pos[w - m->base] & bit, neg = m->neg[w - m->base] & bit;
+  if (pos && neg) return 2;
+  if (pos) return 1;
+  if (neg) return 0;
   return -1;
 }
 
-int Formula::polarity(const string& str) const
+unsigned int Formula::atomsIn(const vector<int>& valuation) const
 {
-  switch (op) {
-  case ATOM:
-    {
-      if (str == atom)
-	return 1;
-      else
-	return -1;
-    }
-    break;
-  case NOT:
-    {
-      int p = right->polarity(str);
-      if (p == 1) return 0;
-      if (p == 0) return 1;
-      if (p == -1) return -1;
-      if (p == 2) return 2;
-    }
-    break;
-  case OR: case AND:
-    {
-      int p1 = left->polarity(str);
-      int p2 = right->polarity(str);
-      if (p1 == -1 && p2 == -1) return -1;
-      if (p1 == 2 || p2 == 2) return 2;
-      if (p1 == 1 && p2 == 0) return 2;
-      if (p1 == 0 && p2 == 1) return 2;
-      if (p1 != -1) return p1;
-      if (p2 != -1) return p2;
-    }
-    break;
-  case IMPLIES:
-    {
-      int p1 = left->polarity(str);
-      int p2 = right->polarity(str);
-      if (p1 == -1 && p2 == -1) return -1;
-      if (p1 == 2 || p2 == 2) return 2;
-      if (p1 == p2) return 2;
-      if (p1 != -1) return !p1;
-      if (p2 != -1) return p2;
-    }
-    break;
-  case ORN: case ANDN:
-    {
-      unsigned int nneg = 0, nnone = 0, npos = 0, nboth = 0;
-      for (unsigned int i = 0; i < fmls.size(); i++) {
-	int p = fmls[i]->polarity(str);
-	if (p == -1) nnone++;
-	else if (p == 0) nneg++;
-	else if (p == 1) npos++;
-	else nboth++;
-      }
-      if (nnone == fmls.size()) return -1;
-      if (nboth > 0) return 2;
-      if (nneg > 0 && npos > 0) return 2;
-      if (nneg > 0) return 0;
-      if (npos > 0) return 1;
-    }
+  Meta scratch;
+  const Meta *m = meta(scratch);
+  unsigned int ret = 0;
+  for (unsigned int i = 0; i < m->atoms.size(); i++) {
+    unsigned int a = m->atoms[i].first;
+    if (a < valuation.size() && valuation[a] != -1)
+      ret += m->atoms[i].second;
   }
-  return -1;
+  return ret;
 }
 
-unsigned int Formula::atomsIn(const map<string, int>& valuation) const
+unsigned int Formula::atomsOut(const vector<int>& valuation) const
 {
-  switch (op) {
-  case ATOM:
-    {
-      if (valuation.find(atom) != valuation.end())
-	return 1;
-      else
-	return 0;
-    }
-    break;
-  case NOT:
-    {
-      return right->atomsIn(valuation);
-    }
-    break;
-  case OR: case AND: case IMPLIES:
-    {
-      return left->atomsIn(valuation) + right->atomsIn(valuation);
-    }
-    break;
-  case ORN: case ANDN:
-    {
-      unsigned int ret = 0;
-      for (unsigned int i = 0; i < fmls.size(); i++)
-	ret += fmls[i]->atomsIn(valuation);
-      return ret;
-    }
+  Meta scratch;
+  const Meta *m = meta(scratch);
+  unsigned int ret = 0;
+  for (unsigned int i = 0; i < m->atoms.size(); i++) {
+    unsigned int a = m->atoms[i].first;
+    if (a >= valuation.size() || valuation[a] == -1)
+      ret += m->atoms[i].second;
   }
-  return 0;
+  return ret;
 }
 
-unsigned int Formula::atomsOut(const map<string, int>& valuation) const
+unsigned int Formula::atomsOut(const vector<bool>& atomset) const
 {
-  switch (op) {
-  case ATOM:
-    {
-      if (valuation.find(atom) == valuation.end())
-	return 1;
-      else
-	return 0;
-    }
-    break;
-  case NOT:
-    {
-      return right->atomsOut(valuation);
-    }
-    break;
-  case OR: case AND: case IMPLIES:
-    {
-      return left->atomsOut(valuation) + right->atomsOut(valuation);
-    }
-    break;
-  case ORN: case ANDN:
-    {
-      unsigned int ret = 0;
-      for (unsigned int i = 0; i < fmls.size(); i++)
-	ret += fmls[i]->atomsOut(valuation);
-      return ret;
-    }
+  Meta scratch;
+  const Meta *m = meta(scratch);
+  unsigned int ret = 0;
+  for (unsigned int i = 0; i < m->atoms.size(); i++) {
+    unsigned int a = m->atoms[i].first;
+    if (a >= atomset.size() || ! atomset[a])
+      ret += m->atoms[i].second;
   }
-  return 0;
+  return ret;
 }
 
-unsigned int Formula::atomsOut(const set<string>& atomset) const
+void Formula::atomIds(vector<unsigned int>& ids) const
 {
-  switch (op) {
-  case ATOM:
-    {
-      if (atomset.find(atom) == atomset.end())
-	return 1;
-      else
-	return 0;
-    }
-    break;
-  case NOT:
-    {
-      return right->atomsOut(atomset);
-    }
-    break;
-  case OR: case AND: case IMPLIES:
-    {
-      return left->atomsOut(atomset) + right->atomsOut(atomset);
-    }
-    break;
-  case ORN: case ANDN:
-    {
-      unsigned int ret = 0;
-      for (unsigned int i = 0; i < fmls.size(); i++)
-	ret += fmls[i]->atomsOut(atomset);
-      return ret;
+  Meta scratch;
+  const Meta *m = meta(scratch);
+  for (unsigned int i = 0; i < m->atoms.size(); i++)
+    ids.push_back(m->atoms[i].first);
+}
+
+double Formula::distanceFrom(const vector<int>& nearest) const
+{
+  Meta scratch;
+  const Meta *m = meta(scratch);
+  double min = 6E+23;
+  for (unsigned int i = 0; i < m->atoms.size(); i++) {
+    unsigned int a = m->atoms[i].first;
+    if (a < nearest.size() && nearest[a] != INT_MAX && nearest[a] < min)
+      min = (double) nearest[a];
+  }
+  return min;
+}
+
+
+// Members of class FormulaFactory.
+
+FormulaFactory::FormulaFactory()
+{
+  _formulas.push_back(NULL);
+}
+
+FormulaFactory::~FormulaFactory()
+{
+  // The subformulas are canonical formulas too, so they are detached
+  // before deleting each formula.
+  for (unsigned int i = 1; i < _formulas.size(); i++) {
+    _formulas[i]->left = _formulas[i]->right = NULL;
+    _formulas[i]->fmls.clear();
+    delete _formulas[i];
+  }
+}
+
+size_t FormulaFactory::KeyHash::operator()(const Key& k) const
+{
+  size_t h = (size_t) k.op;
+  h = h * 1000003 ^ k.l;
+  h = h * 1000003 ^ k.r;
+  for (unsigned int i = 0; i < k.ids.size(); i++)
+    h = h * 1000003 ^ k.ids[i];
+  return h;
+}
+
+Formula *FormulaFactory::insert(const Key& key, Formula *fml)
+{
+  fml->id = _formulas.size();
+  _formulas.push_back(fml);
+  _nodes[key] = fml;
+  return fml;
+}
+
+unsigned int FormulaFactory::atomCount() const
+{
+  lock_guard<mutex> guard(_mutex);
+  return _atomNames.size();
+}
+
+string FormulaFactory::atomName(unsigned int atom) const
+{
+  lock_guard<mutex> guard(_mutex);
+  return _atomNames[atom];
+}
+
+Formula *FormulaFactory::get(unsigned int id) const
+{
+  lock_guard<mutex> guard(_mutex);
+  return _formulas[id];
+}
+
+unsigned int FormulaFactory::size() const
+{
+  lock_guard<mutex> guard(_mutex);
+  return _formulas.size() - 1;
+}
+
+FormulaFactory::Key FormulaFactory::keyOf(const Formula *fml)
+{
+  Key key;
+  key.op = fml->op;
+  key.l = fml->left != NULL ? fml->left->id : 0;
+  key.r = fml->right != NULL ? fml->right->id : 0;
+  for (unsigned int i = 0; i < fml->fmls.size(); i++)
+    key.ids.push_back(fml->fmls[i]->id);
+  return key;
+}
+
+void FormulaFactory::rollback(unsigned int m)
+{
+  lock_guard<mutex> guard(_mutex);
+
+  // Newest first, so the atom ids freed are the last ones
+  while (_formulas.size() > m + 1) {
+    Formula *fml = _formulas.back();
+    _formulas.pop_back();
+    if (fml->op == Formula::ATOM) {
+      _atoms.erase(fml->atom);
+      _atomNames.pop_back();
     }
+    else
+      _nodes.erase(keyOf(fml));
+
+    // The subformulas are canonical, so they are detached first
+    fml->left = fml->right = NULL;
+    fml->fmls.clear();
+    delete fml;
   }
-  return 0;
 }
 
-double Formula::distanceFrom(const map<string, int>& valuation,
-			     const map<string, int>& atom_dist) const
+Formula *FormulaFactory::atom(const string& a)
 {
-  switch (op) {
-  case ATOM:
-    {
-      double d = 6E+23;
-      map<string, int>::const_iterator v;
-      for (v = valuation.begin(); v != valuation.end(); v++) {
-	string key = atom + "," + v->first;
-	map<string, int>::const_iterator it = atom_dist.find(key);
-	if (it != atom_dist.end()) {
-	  if ((double) it->second < d)
-	    d = (double) it->second;
-	}
+  return atom(a.data(), a.size());
+}
+
+Formula *FormulaFactory::atom(const char *a, size_t n)
+{
+  lock_guard<mutex> guard(_mutex);
+  _name.assign(a, n);
+  unordered_map<string, Formula *>::const_iterator it = _atoms.find(_name);
+  if (it != _atoms.end())
+    return it->second;
+
+  ArenaScope heap(NULL);
+  Formula *fml = new Formula(_name);
+  fml->atomId = _atomNames.size();
+  _atomNames.push_back(_name);
+  fml->id = _formulas.size();
+  _formulas.push_back(fml);
+  _atoms[_name] = fml;
+  return fml;
+}
+
+Formula *FormulaFactory::make(Formula::opType t, Formula *r)
+{
+  lock_guard<mutex> guard(_mutex);
+  assert(r->id != 0);
+
+  Key key;
+  key.op = t;
+  key.l = 0;
+  key.r = r->id;
+  unordered_map<Key, Formula *, KeyHash>::const_iterator it = _nodes.find(key);
+  if (it != _nodes.end())
+    return it->second;
+  ArenaScope heap(NULL);
+  return insert(key, new Formula(t, r));
+}
+
+Formula *FormulaFactory::make(Formula::opType t, Formula *l, Formula *r)
+{
+  lock_guard<mutex> guard(_mutex);
+  assert(l->id != 0 && r->id != 0);
+
+  Key key;
+  key.op = t;
+  key.l = l->id;
+  key.r = r->id;
+  unordered_map<Key, Formula *, KeyHash>::const_iterator it = _nodes.find(key);
+  if (it != _nodes.end())
+    return it->second;
+  ArenaScope heap(NULL);
+  return insert(key, new Formula(t, l, r));
+}
+
+Formula *FormulaFactory::make(Formula::opType t, vector<Formula *>& vfml)
+{
+  lock_guard<mutex> guard(_mutex);
+  Key key;
+  key.op = t;
+  key.l = key.r = 0;
+  for (unsigned int i = 0; i < vfml.size(); i++) {
+    assert(vfml[i]->id != 0);
+    key.ids.push_back(vfml[i]->id);
+  }
+  unordered_map<Key, Formula *, KeyHash>::const_iterator it = _nodes.find(key);
+  if (it != _nodes.end())
+    return it->second;
+  ArenaScope heap(NULL);
+  return insert(key, new Formula(t, vfml));
+}
+
+Formula *FormulaFactory::intern(const Formula *fml)
+{
+  // Postorder traversal: when a formula is visited the second time,
+  // the canonical instances of its subformulas are on top of made.
+  vector<pair<const Formula *, bool> > pending(1, make_pair(fml, false));
+  vector<Formula *> made;
+  while (! pending.empty()) {
+    const Formula *f = pending.back().first;
+
+    if (f->op == Formula::ATOM) {
+      pending.pop_back();
+      made.push_back(atom(f->atom));
+      continue;
+    }
+
+    if (! pending.back().second) {
+      pending.back().second = true;
+      if (f->op == Formula::NOT)
+	pending.push_back(make_pair(f->right, false));
+      else if (f->op == Formula::ANDN || f->op == Formula::ORN)
+	for (unsigned int i = f->fmls.size(); i > 0; i--)
+	  pending.push_back(make_pair(f->fmls[i-1], false));
+      else {
+	pending.push_back(make_pair(f->right, false));
+	pending.push_back(make_pair(f->left, false));
+      }
+      continue;
+    }
+    pending.pop_back();
+
+    Formula *canonical;
+    switch (f->op) {
+    case Formula::NOT:
+      canonical = make(f->op, made.back());
+      made.pop_back();
+      break;
+    case Formula::AND: case Formula::OR: case Formula::IMPLIES:
+      {
+	Formula *r = made.back();
+	made.pop_back();
+	Formula *l = made.back();
+	made.pop_back();
+	canonical = make(f->op, l, r);
+      }
+      break;
+    default:
+      {
+	vector<Formula *> vfml(made.end() - f->fmls.size(), made.end());
+	made.resize(made.size() - f->fmls.size());
+	canonical = make(f->op, vfml);
       }
-      return d;
-    }
-    break;
-  case NOT:
-    {
-      return right->distanceFrom(valuation, atom_dist);
-    }
-    break;
-  case OR: case AND: case IMPLIES:
-    {
-      double l = left->distanceFrom(valuation, atom_dist);
-      double r = right->distanceFrom(valuation, atom_dist);
-      if (l < r)
-	return l;
-      return r;
-    }
-    break;
-  case ORN: case ANDN:
-    {
-      double min = 6E+23;
-      for (unsigned int i = 0; i < fmls.size(); i++)
-	if (fmls[i]->distanceFrom(valuation, atom_dist) < min)
-	  min = fmls[i]->distanceFrom(valuation, atom_dist);
-      return min;
     }
+    made.push_back(canonical);
   }
-  return 6E+23;
+  return made.back();
+}
+
+// The current factory of the thread.
+static thread_local FormulaFactory *t_factory = NULL;
+
+FormulaFactory *FormulaFactory::current() { return t_factory; }
+
+void FormulaFactory::setCurrent(FormulaFactory *factory)
+{
+  t_factory = factory;
+}
+
+FormulaFactory& formulaFactory()
+{
+  if (t_factory != NULL)
+    return *t_factory;
+  static FormulaFactory factory;
+  return factory;
 }
 
 
@@ -439,18 +739,50 @@ struct parsed_item {
   Formula::opType op;
 };
 
+const char *ParseStatus::message() const
+{
+  switch (code) {
+  case OK: return "no error";
+  case EMPTY: return "empty formula";
+  case UNEXPECTED_CHAR: return "unexpected character";
+  case MISSING_OPERAND: return "missing operand";
+  case MISSING_OPERATOR: return "missing operator";
+  case MIXED_OPERATORS: return "different operators without parenthesis";
+  case TOO_MANY_OPERANDS: return "more than two operands of ->";
+  case UNBALANCED: return "unbalanced parenthesis";
+  case NO_FILE: return "cannot read file";
+  case BAD_SIGN: return "sign other than T or F";
+  case BAD_PROBLEM_LINE: return "malformed problem line";
+  case BAD_LITERAL: return "malformed literal";
+  case EMPTY_CLAUSE: return "empty clause";
+  case UNTERMINATED_CLAUSE: return "clause without 0";
+  }
+  return "unknown error";
+}
+
 // Parse a formula from a string. The formula (and its subformulas
-// except atoms) must be enclosed in parenthesis. Returns a newly
-// allocated pointer to the formula represented by the string or a
-// null pointer if the string is not a valid formula.
+// except atoms) must be enclosed in parenthesis. Returns the canonical
+// formula represented by the string or a null pointer if the string
+// is not a valid formula.
 Formula *parse(const string& s)
 {
-  
-  Formula *retval;
-  unsigned int i;
+  Formula *fml;
+  parse(s.data(), s.size(), fml);
+  return fml;
+}
+
+// Parses the n bytes at s in place: atoms are interned straight from
+// them. The formulas built before an error are rolled back.
+ParseStatus parse(const char *s, size_t n, Formula *&fml)
+{
+  FormulaFactory& factory = formulaFactory();
+  unsigned int mark = factory.mark();
+  size_t i;
   stack<parsed_item> S;
+  ParseStatus status;
 
-  for (i = 0; i < s.size(); ) {
+  fml = NULL;
+  for (i = 0; i < n && status.ok(); ) {
     parsed_item item;
     if (s[i] == ' ')
       i++;
@@ -459,20 +791,22 @@ Formula *parse(const string& s)
       S.push(item);
       i++;
     }
-    else if (isalnum(s[i])) {
-      string a;
-      while (i < s.size() && (isalnum(s[i]) || s[i] == '_' || s[i] == ',')) {
-	a += s[i];
+    else if (isalnum((unsigned char) s[i])) {
+      // The bytes are cast, as isalnum() is undefined for the negative
+      // chars of the bytes beyond ASCII
+      size_t start = i;
+      while (i < n &&
+	     (isalnum((unsigned char) s[i]) || s[i] == '_' || s[i] == ','))
 	i++;
-      }
+      Formula *a = factory.atom(s + start, i - start);
       item.type = PARSE_FORM;
       if (!S.empty() && S.top().type == PARSE_OPER &&
 	  S.top().op == Formula::NOT) {
-	item.formula = new Formula(Formula::NOT, new Formula(a));
+	item.formula = factory.make(Formula::NOT, a);
 	S.pop();
       }
       else
-	item.formula = new Formula(a);
+	item.formula = a;
       S.push(item);
     }
     else if (s[i] == '!') {
@@ -493,7 +827,7 @@ Formula *parse(const string& s)
       S.push(item);
       i++;
     }
-    else if (i+1 < s.size() && s[i] == '-' && s[i+1] == '>') {
+    else if (i+1 < n && s[i] == '-' && s[i+1] == '>') {
       item.type = PARSE_OPER;
       item.op = Formula::IMPLIES;
       S.push(item);
@@ -502,66 +836,73 @@ Formula *parse(const string& s)
     else if (s[i] == ')') {
       Formula *result;
 
-      assert(!S.empty() && S.top().type == PARSE_FORM);
+      if (S.empty() || S.top().type != PARSE_FORM) {
+	status = ParseStatus(S.empty() ? ParseStatus::UNBALANCED :
+			     ParseStatus::MISSING_OPERAND, i);
+	break;
+      }
 
       vector<Formula *> fmls;
-//        Formula *right = S.top().formula;
       fmls.push_back(S.top().formula);
       S.pop();
 
-      assert(!S.empty() &&
-	     (S.top().type == PARSE_OPEN || S.top().type == PARSE_OPER));
-      
-      Formula::opType op = S.top().op;
-      while (S.top().type == PARSE_OPER) {
-	assert(op == S.top().op);
+      if (S.empty()) {
+	status = ParseStatus(ParseStatus::UNBALANCED, i);
+	break;
+      }
+      if (S.top().type == PARSE_FORM) {
+	status = ParseStatus(ParseStatus::MISSING_OPERATOR, i);
+	break;
+      }
+
+      Formula::opType op =
+	S.top().type == PARSE_OPER ? S.top().op : Formula::ATOM;
+      while (! S.empty() && S.top().type == PARSE_OPER) {
+	if (op != S.top().op) {
+	  status = ParseStatus(ParseStatus::MIXED_OPERATORS, i);
+	  break;
+	}
 	S.pop();
 
-	assert(!S.empty() && S.top().type == PARSE_FORM);
+	if (S.empty() || S.top().type != PARSE_FORM) {
+	  status = ParseStatus(ParseStatus::MISSING_OPERAND, i);
+	  break;
+	}
 
 	fmls.insert(fmls.begin(), S.top().formula);
 	S.pop();
       }
+      if (! status.ok())
+	break;
 
-      assert(!S.empty() && S.top().type == PARSE_OPEN);
+      if (S.empty() || S.top().type != PARSE_OPEN) {
+	status = ParseStatus(S.empty() ? ParseStatus::UNBALANCED :
+			     ParseStatus::MISSING_OPERATOR, i);
+	break;
+      }
 
       S.pop();
 
       if (fmls.size() > 2) {
-	assert (op == Formula::AND || op == Formula::OR);
+	if (op != Formula::AND && op != Formula::OR) {
+	  status = ParseStatus(ParseStatus::TOO_MANY_OPERANDS, i);
+	  break;
+	}
 	if (op == Formula::AND)
 	  op = Formula::ANDN;
 	else
 	  op = Formula::ORN;
-	result = new Formula(op, fmls);
+	result = factory.make(op, fmls);
       }
       else if (fmls.size() == 2)
-	result = new Formula(op, fmls[0], fmls[1]);
+	result = factory.make(op, fmls[0], fmls[1]);
       else // fmls.size() == 1
 	result = fmls[0];
-	
-
-//        if (S.top().type == PARSE_OPER) {
-//  	Formula::opType op = S.top().op;
-//  	S.pop();
 
-//  	assert(!S.empty() && S.top().type == PARSE_FORM);
-
-//  	Formula *left = S.top().formula;
-//  	S.pop();
-//  	result = new Formula(op, left, right);
-//        }
-//        else
-//  	result = right;
-
-//        assert(!S.empty() && S.top().type == PARSE_OPEN);
-
-//        S.pop();
-      
       item.type = PARSE_FORM;
       if (!S.empty() && S.top().type == PARSE_OPER &&
 	  S.top().op == Formula::NOT) {
-	item.formula = new Formula(Formula::NOT, result);
+	item.formula = factory.make(Formula::NOT, result);
 	S.pop();
       }
       else
@@ -569,12 +910,32 @@ Formula *parse(const string& s)
       S.push(item);
       i++;
     }
+    else
+      status = ParseStatus(ParseStatus::UNEXPECTED_CHAR, i);
+  }
+
+  if (status.ok()) {
+    if (S.empty())
+      status = ParseStatus(ParseStatus::EMPTY, n);
+    else if (S.size() > 1 || S.top().type != PARSE_FORM) {
+      // An open parenthesis, a dangling operator or two formulas
+      parsed_type last = S.top().type;
+      while (S.size() > 1)
+	S.pop();
+      if (S.top().type == PARSE_OPEN)
+	status = ParseStatus(ParseStatus::UNBALANCED, n);
+      else if (last == PARSE_OPER)
+	status = ParseStatus(ParseStatus::MISSING_OPERAND, n);
+      else
+	status = ParseStatus(ParseStatus::MISSING_OPERATOR, n);
+    }
   }
 
-  assert(!S.empty() && S.top().type == PARSE_FORM);
-  retval = S.top().formula;
-  S.pop();
-  assert(S.empty());
-  
-  return retval;
+  if (! status.ok()) {
+    factory.rollback(mark);
+    return status;
+  }
+
+  fml = S.top().formula;
+  return status;
 }
@@ -8,10 +8,15 @@
 #ifndef __FORMULA_H__
 #define __FORMULA_H__
 
+#include <atomic>
 #include <string>
 #include <vector>
 #include <map>
+#include <mutex>
 #include <set>
+#include <unordered_map>
+
+#include "arena.h"
 
 using namespace std;
 
@@ -31,49 +36,64 @@ class Formula
   // Constructor for opType = ATOM.
   Formula(const string& a);
 
-  // Copy constructor.
+  // Copy constructor. The copy keeps the id of rhs.
   Formula(const Formula& rhs);
 
   // Destructor. Destroys all subformulas.
   ~Formula();
 
+  // Formulas are allocated in the current arena, if any (see arena.h).
+  static void *operator new(size_t size) { return Arena::alloc(size, finalize); }
+  static void operator delete(void *p) { Arena::dealloc(p); }
+
   // Returns a string representation of the formula.
   string toString() const;
 
-  // Returns the size of the formula (atom ocurrences + operator ocurrences)
+  // Returns the size of the formula (atom ocurrences + operator
+  // ocurrences). The queries below (except value) are answered from
+  // metadata cached by canonical formulas on first use. None of the
+  // operations on formulas recurse, so the depth of a formula is
+  // limited only by memory.
   unsigned int size(bool count_atoms = true) const;
 
-  // Returns the value of the formula according to a valuation. Returns:
+  // Returns the value of the formula according to a valuation,
+  // indexed by atom id, where valuation[a] is -1 (undefined), 0 or 1.
+  // Returns:
   // -1: undefined
   //  0: false
   //  1: true
-  int value(map<string, int>& valuation) const;
+  int value(const vector<int>& valuation) const;
 
-  // Returns the polarity of the specified atom in the formula. Returns:
+  // Returns the polarity of the atom with the specified id in the
+  // formula. Returns:
   // -1: no ocurrences of this atom on the formula
   //  0: negative polarity
   //  1: positive polarity
   //  2: ocurrences of both polarities
-  int polarity(const string& atom) const;
+  int polarity(unsigned int atom) const;
 
   // Counts the number of ocurrences of atoms in the formula that are
   // described in valuation.
-  unsigned int atomsIn(const map<string, int>& valuation) const;
+  unsigned int atomsIn(const vector<int>& valuation) const;
 
   // Counts the number of ocurrences of atoms in the formula that are
   // not described in valuation.
-  unsigned int atomsOut(const map<string, int>& valuation) const;
+  unsigned int atomsOut(const vector<int>& valuation) const;
 
   // Counts the number of ocurrences of atoms in the formula that are
-  // not described in the atom set.
-  unsigned int atomsOut(const set<string>& atomset) const;
+  // not described in the atom set, indexed by atom id.
+  unsigned int atomsOut(const vector<bool>& atomset) const;
+
+  // Appends to ids the ids of the atoms ocurring in the formula, each
+  // one once, in increasing order.
+  void atomIds(vector<unsigned int>& ids) const;
 
   // Returns the distance between the formula and the set of atoms in
-  // the valuation. This distance is the minimum distance between an
+  // a valuation. This distance is the minimum distance between an
   // atom occurring in the formula and an atom described in the
-  // valuation.
-  double distanceFrom(const map<string, int>& valuation,
-		      const map<string, int>& atom_dist) const;
+  // valuation. nearest[a] is the distance between the atom a and the
+  // nearest atom described in the valuation (INT_MAX if unknown).
+  double distanceFrom(const vector<int>& nearest) const;
 
   // If operator == ANDN or ORN, then the elements of vector fmls must
   // be not NULL, and the string atom and the pointers left and right
@@ -94,6 +114,10 @@ class Formula
   // Atom.
   string atom;
 
+  // Id of the atom in the atom table of the formula factory, for
+  // opType = ATOM. Atom ids are dense, starting at 0.
+  unsigned int atomId;
+
   // Left formula.
   Formula *left;
 
@@ -102,15 +126,184 @@ class Formula
 
   // Vector of formulas for operators ANDN and ORN.
   vector<Formula *> fmls;
+
+  // Id of the canonical instance of the formula in the formula
+  // factory, or 0 if the formula was not built by the factory.
+  // Structurally equal formulas have the same id.
+  unsigned int id;
+
+ private:
+  // Metadata of a canonical formula: its size, the ocurrences of each
+  // atom, and the atoms ocurring with positive and negative polarity
+  // as bitsets.
+  struct Meta;
+
+  // Returns the metadata of the formula. Canonical formulas compute it
+  // on first use; other formulas compute it into scratch every time.
+  const Meta *meta(Meta& scratch) const;
+
+  // Computes the metadata of the formula into m.
+  void computeMeta(Meta& m) const;
+
+  // Returns a new formula equal to fml, sharing its subformulas.
+  static Formula *shallowCopy(const Formula *fml);
+
+  // Appends the subformulas to subs and detaches them.
+  void detach(vector<Formula *>& subs);
+
+  // Destroys a formula allocated in an arena. Its subformulas are in
+  // the arena too (or are canonical), so they are detached first.
+  static void finalize(void *p);
+
+  mutable atomic<Meta *> _meta;
+};
+
+
+// Builds formulas by hash-consing: structurally equal formulas built
+// by the factory share a single canonical instance, identified by a
+// stable integer id. The factory owns the canonical instances, so
+// they must never be deleted. They are always allocated in the heap,
+// even if there is a current arena. All the members but rollback()
+// may be called by several threads at once.
+class FormulaFactory
+{
+ public:
+  FormulaFactory();
+  ~FormulaFactory();
+
+  // Returns the canonical formula for the atom a, or for the atom
+  // named by the n bytes at a.
+  Formula *atom(const string& a);
+  Formula *atom(const char *a, size_t n);
+  // Returns the canonical formula for opType = NOT. r must be canonical.
+  Formula *make(Formula::opType t, Formula *r);
+  // Returns the canonical formula for opType = AND, OR or IMPLIES. l
+  // and r must be canonical.
+  Formula *make(Formula::opType t, Formula *l, Formula *r);
+  // Returns the canonical formula for opType = ANDN or ORN. The
+  // elements of vfml must be canonical.
+  Formula *make(Formula::opType t, vector<Formula *>& vfml);
+
+  // Returns the canonical formula structurally equal to fml.
+  Formula *intern(const Formula *fml);
+
+  // Returns the number of distinct atoms built by the factory.
+  unsigned int atomCount() const;
+
+  // Returns the name of the atom with the specified id.
+  string atomName(unsigned int atom) const;
+
+  // Returns the canonical formula with the specified id.
+  Formula *get(unsigned int id) const;
+
+  // Returns the number of canonical formulas.
+  unsigned int size() const;
+
+  // Returns a mark of the formulas built so far, to be passed to
+  // rollback().
+  unsigned int mark() const { return size(); }
+
+  // Destroys the formulas built after the mark m, which must not be
+  // in use. The factory must not be used by other threads meanwhile.
+  void rollback(unsigned int m);
+
+  // Returns the current factory of the calling thread, or NULL.
+  static FormulaFactory *current();
+
+  // Sets the current factory of the calling thread (NULL for the
+  // global one).
+  static void setCurrent(FormulaFactory *factory);
+
+ private:
+  // Key of a non-atomic formula: its operator and the ids of its
+  // immediate subformulas.
+  struct Key {
+    Formula::opType op;
+    unsigned int l, r;
+    vector<unsigned int> ids;
+    bool operator==(const Key& k) const
+    { return op == k.op && l == k.l && r == k.r && ids == k.ids; }
+  };
+  struct KeyHash {
+    size_t operator()(const Key& k) const;
+  };
+
+  // Registers fml as the canonical instance of key.
+  Formula *insert(const Key& key, Formula *fml);
+
+  // Returns the key of the non-atomic canonical formula fml.
+  static Key keyOf(const Formula *fml);
+
+  unordered_map<string, Formula *> _atoms;
+  unordered_map<Key, Formula *, KeyHash> _nodes;
+
+  // Atom names indexed by atom id.
+  vector<string> _atomNames;
+
+  // Canonical formulas indexed by id (_formulas[0] is NULL).
+  vector<Formula *> _formulas;
+
+  // Scratch key of atom(), so looking up a known atom allocates
+  // nothing.
+  string _name;
+
+  // Serializes the calls, as the vectors above may be reallocated by
+  // atom() and make() while other threads read them.
+  mutable mutex _mutex;
+};
+
+// Returns the formula factory used by the parser and the tableaux:
+// the current factory of the calling thread, if any, or a global one.
+// Formulas of different factories must not be mixed.
+FormulaFactory& formulaFactory();
+
+// Sets the current factory of the calling thread while in scope.
+class FactoryScope
+{
+ public:
+  FactoryScope(FormulaFactory *factory)
+    : _previous(FormulaFactory::current())
+  { FormulaFactory::setCurrent(factory); }
+  ~FactoryScope() { FormulaFactory::setCurrent(_previous); }
+
+ private:
+  FormulaFactory *_previous;
+};
+
+
+// Result of reading a formula or a problem file: OK, or the error
+// found and the offset of the byte where it was found. Reporting an
+// error allocates nothing.
+struct ParseStatus
+{
+  enum Code {OK, EMPTY, UNEXPECTED_CHAR, MISSING_OPERAND,
+	     MISSING_OPERATOR, MIXED_OPERATORS, TOO_MANY_OPERANDS,
+	     UNBALANCED, NO_FILE, BAD_SIGN, BAD_PROBLEM_LINE, BAD_LITERAL,
+	     EMPTY_CLAUSE, UNTERMINATED_CLAUSE};
+
+  ParseStatus(Code c = OK, size_t o = 0) : code(c), offset(o) { }
+
+  bool ok() const { return code == OK; }
+
+  // Returns a description of the code.
+  const char *message() const;
+
+  Code code;
+  size_t offset;
 };
 
 
 // Utility functions
 
 // Parse a formula from a string. The formula (and its subformulas
-// except atoms) must be enclosed in parenthesis. Returns a newly
-// allocated pointer to the formula represented by the string or a
-// null pointer if the string is not a valid formula.
+// except atoms) must be enclosed in parenthesis. Returns the canonical
+// formula represented by the string or a null pointer if the string
+// is not a valid formula.
 Formula *parse(const string& s);
 
+// Parses the n bytes at s in place, setting fml to the canonical
+// formula they represent. On error, sets fml to NULL and destroys the
+// formulas the parse built (see FormulaFactory::rollback()).
+ParseStatus parse(const char *s, size_t n, Formula *&fml);
+
 #endif
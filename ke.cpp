@@ -27,35 +27,8 @@ unsigned int KEStrategy::chooseAlpha() { return 0; }
 
 bool KEStrategy::hasApplicableBeta()
 {
-
-  //  cout << "hasAppBeta:" << endl;
-
-  hasAppBeta = false;
   indexAppBeta = 0;
-
-  unsigned int i, j;
-  for (i = 0; i < _betas->size() && ! hasAppBeta; i++) {
-    for (j = 0; j < _lits->size() && ! hasAppBeta; j++) {
-      vector<SignedFormula *> dummyin, dummyout;
-      dummyin.push_back((*_betas)[i]);
-      dummyin.push_back((*_lits)[j]);      
-      hasAppBeta = hasAppBeta
-	|| KE_beta_E_OR_1     (dummyin, dummyout)
-	|| KE_beta_E_OR_2     (dummyin, dummyout)
-	|| KE_beta_E_ORN      (dummyin, dummyout)
-	|| KE_beta_E_NOT_AND_1(dummyin, dummyout)
-	|| KE_beta_E_NOT_AND_2(dummyin, dummyout)
-	|| KE_beta_E_NOT_ANDN (dummyin, dummyout)
-	|| KE_beta_E_IMPLIES_1(dummyin, dummyout)
-	|| KE_beta_E_IMPLIES_2(dummyin, dummyout);
-      if (hasAppBeta) {
-	indexAppBeta = i;
-	indexAppLit = j;
-	//	cout << "Beta: " << (*_betas)[i]->toString()
-	//	     << " with " << (*_lits)[j]->toString() << endl;
-      }
-    }
-  }
+  hasAppBeta = _branch->applicableBeta(indexAppBeta, indexAppLit);
 
   return hasAppBeta;
 }
@@ -72,18 +45,18 @@ Formula *KEStrategy::choosePB()
   case Formula::OR:
   case Formula::AND:
   case Formula::IMPLIES:
-    ret = new Formula(*((*_betas)[indexAppPB]->formula->left));
+    ret = (*_betas)[indexAppPB]->formula->left;
     break;
   case Formula::ORN:
   case Formula::ANDN:
-    ret = new Formula(*((*_betas)[indexAppPB]->formula->fmls[0]));
+    ret = (*_betas)[indexAppPB]->formula->fmls[0];
     break;
   default:
     ret = NULL;
   }
 
   assert(ret != NULL);
-  appliedPB[(*_betas)[indexAppPB]->toString()] = id;
+  _branch->applyPB((*_betas)[indexAppPB]);
     
   return ret;
 }
@@ -97,23 +70,9 @@ int KEStrategy::nextRule()
     return 1; // beta
   else if (! _betas->empty()) {
     unsigned int choice = 0;
-    while (choice < _betas->size()) {
-      map<string, string>::const_iterator it =
-	appliedPB.find((*_betas)[choice]->toString());
-      if (it != appliedPB.end()) {
-	//	cout << it->first;
-	if (it->second == id.substr(0, it->second.length())) {
-	  //	  cout << ": applied in " << it->second << endl;
-	  choice++;
-	}
-	else {
-	  //	  cout << ": not applied" << endl;
-	  break;
-	}
-      }
-      else
-	break;
-    }
+    while (choice < _betas->size() &&
+	   _branch->appliedPB((*_betas)[choice]))
+      choice++;
     if (choice == _betas->size())
       return -1; // none
     else {
@@ -125,6 +84,8 @@ int KEStrategy::nextRule()
     return -1; // none
 }
 
+KEStrategy *KEStrategy::clone() const { return new KEStrategy(*this); }
+
 
 //////////////////////////////////////////////////////////////////////////////
 // Members of class KEValuationStrategy.
@@ -134,34 +95,30 @@ KEValuationStrategy::KEValuationStrategy() : KEStrategy() { }
 
 KEValuationStrategy::~KEValuationStrategy() { }
 
+KEStrategy *KEValuationStrategy::clone() const
+{
+  return new KEValuationStrategy(*this);
+}
+
 Formula *KEValuationStrategy::choosePB()
 {
   unsigned int k;
 
-  // Construct the valuation <atom, value>, with value in {*, 0, 1} (* = -1)
-  map<string, int> valuation;
-  for (k = 0; k < _lits->size(); k++)
-    if ((*_lits)[k]->type() == SignedFormula::LITERAL) {
-      if ((*_lits)[k]->sign == SignedFormula::S_F)
-	valuation[(*_lits)[k]->formula->atom] = 0;
-      else // S_T
-	valuation[(*_lits)[k]->formula->atom] = 1;
-    }
+  // Valuation <atom, value> of the branch, with value in {*, 0, 1} (* = -1)
+  const vector<int>& valuation = branchValuation();
+  const vector<int>& nearest = _branch->nearest(_atom_dist);
   
   // Check valuation against _betas. We'll choose the formula with
   // minimum distance from the valuation.
 
   unsigned int choice = indexAppPB;
-  double min = (*_betas)[indexAppPB]->distanceFrom(valuation, _atom_dist);
+  double min = (*_betas)[indexAppPB]->distanceFrom(nearest);
   unsigned int minind = indexAppPB;
 
   for (k = indexAppPB; k < _betas->size(); k++) {
-    map<string, string>::const_iterator it =
-      appliedPB.find((*_betas)[k]->toString());
-    if ((it == appliedPB.end()
-	 || it->second != id.substr(0, it->second.length())) &&
+    if (! _branch->appliedPB((*_betas)[k]) &&
 	(*_betas)[k]->value(valuation) < 1) {
-      double dfv = (*_betas)[k]->distanceFrom(valuation, _atom_dist);
+      double dfv = (*_betas)[k]->distanceFrom(nearest);
       if (dfv < min) {
 	min = dfv;
 	minind = k;
@@ -177,18 +134,18 @@ Formula *KEValuationStrategy::choosePB()
   case Formula::OR:
   case Formula::AND:
   case Formula::IMPLIES:
-    ret = new Formula(*((*_betas)[choice]->formula->left));
+    ret = (*_betas)[choice]->formula->left;
     break;
   case Formula::ORN:
   case Formula::ANDN:
-    ret = new Formula(*((*_betas)[choice]->formula->fmls[0]));
+    ret = (*_betas)[choice]->formula->fmls[0];
     break;
   default:
     ret = NULL;
   }
 
   assert (ret != NULL);
-  appliedPB[(*_betas)[choice]->toString()] = id;
+  _branch->applyPB((*_betas)[choice]);
   
   return ret;
 }
@@ -202,19 +159,18 @@ KEPolarityStrategy::KEPolarityStrategy() : KEStrategy() { }
 
 KEPolarityStrategy::~KEPolarityStrategy() { }
 
+KEStrategy *KEPolarityStrategy::clone() const
+{
+  return new KEPolarityStrategy(*this);
+}
+
 Formula *KEPolarityStrategy::choosePB()
 {
   unsigned int k, choice;
 
-  // Construct the valuation <atom, value>, with value in {*, 0, 1} (* = -1)
-  map<string, int> valuation;
-  for (k = 0; k < _lits->size(); k++)
-    if ((*_lits)[k]->type() == SignedFormula::LITERAL) {
-      if ((*_lits)[k]->sign == SignedFormula::S_F)
-	valuation[(*_lits)[k]->formula->atom] = 0;
-      else // S_T
-	valuation[(*_lits)[k]->formula->atom] = 1;
-    }
+  // Valuation <atom, value> of the branch, with value in {*, 0, 1} (* = -1)
+  const vector<int>& valuation = branchValuation();
+  const vector<int>& nearest = _branch->nearest(_atom_dist);
   
   // Check valuation against _betas. We'll choose the formula with
   // minimum distance from the valuation given by the lits of the node.
@@ -227,24 +183,22 @@ Formula *KEPolarityStrategy::choosePB()
   minindv = minindp = indexAppPB;
   
   for (k = indexAppPB; k < _betas->size(); k++) {
-    map<string, string>::const_iterator it =
-      appliedPB.find((*_betas)[k]->toString());
-    if ((it == appliedPB.end()
-	 || it->second != id.substr(0, it->second.length())) &&
+    if (! _branch->appliedPB((*_betas)[k]) &&
 	(*_betas)[k]->value(valuation) < 1) {
-      double dfvv = (*_betas)[k]->distanceFrom(valuation, _atom_dist);
+      double dfvv = (*_betas)[k]->distanceFrom(nearest);
       if (dfvv < minv) {
 	minv = dfvv;
 	minindv = k;
       }
-      for (map<string, int>::const_iterator vit = valuation.begin();
-	   vit != valuation.end(); vit++)
-	if ((*_betas)[k]->polarity(vit->first) == -vit->second) {
-  	  double dfvp = (*_betas)[k]->distanceFrom(valuation, _atom_dist);
+      for (unsigned int a = 0; a < valuation.size(); a++)
+	if (valuation[a] != -1 &&
+	    (*_betas)[k]->polarity(a) == -valuation[a]) {
+  	  double dfvp = (*_betas)[k]->distanceFrom(nearest);
   	  if (dfvp < minp) {
 	    minp = dfvp;
 	    minindp = k;
 	  }
+	  break;
 	}
     }
   }
@@ -260,18 +214,18 @@ Formula *KEPolarityStrategy::choosePB()
   case Formula::OR:
   case Formula::AND:
   case Formula::IMPLIES:
-    ret = new Formula(*((*_betas)[choice]->formula->left));
+    ret = (*_betas)[choice]->formula->left;
     break;
   case Formula::ORN:
   case Formula::ANDN:
-    ret = new Formula(*((*_betas)[choice]->formula->fmls[0]));
+    ret = (*_betas)[choice]->formula->fmls[0];
     break;
   default:
     ret =  NULL;
   }
 
   assert(ret != NULL);
-  appliedPB[(*_betas)[choice]->toString()] = id;
+  _branch->applyPB((*_betas)[choice]);
 
   return ret;
 }
@@ -282,18 +236,19 @@ Formula *KEPolarityStrategy::choosePB()
 //////////////////////////////////////////////////////////////////////////////
 
 KETableau::KETableau(const string& id, SignedFormula *fml,
-		     KETableau *parent)
-  : Tableau(id, fml, parent)
+		     KETableau *parent, BranchState *branch)
+  : Tableau(id, fml, parent, branch), _alphas(_branch->alphas),
+    _betas(_branch->betas), _lits(_branch->lits)
 {
   _closed = false;
-
-  // Initialization of _alphas, _betas and _lits
-  if (parent != NULL) {
-    _alphas.insert(_alphas.end(),
-		   parent->_alphas.begin(), parent->_alphas.end());
-    _betas.insert(_betas.end(), parent->_betas.begin(), parent->_betas.end());
-    _lits.insert(_lits.end(), parent->_lits.begin(), parent->_lits.end());  
-  }
+  _learning = parent ? parent->_learning : false;
+  _backjumping = parent ? parent->_backjumping : false;
+  _level = parent ? parent->_level + 1 : 0;
+  _deps = NULL;
+  _transpositions = parent ? parent->_transpositions : NULL;
+  _pb = NULL;
+  _task = NULL;
+  _strategy2 = NULL;
 
   // Initialization of _rules
   _rules.push_back(&KE_alpha_E_NOT_OR);
@@ -334,11 +289,10 @@ KETableau::KETableau(const string& id, SignedFormula *fml,
 	|| applyRule(B_E_IMPLIES_2, in, out);
       
       if (success) {
+	depend(in, out);
 	_items.insert(_items.end(), out.begin(), out.end());
 	//	cout << "beta: " << _betas[i]->toString() << endl;
-	vector<SignedFormula *>::iterator it = _betas.begin();
-	for (unsigned int m = 0; m < i; m++) it++;
-	_betas.erase(it);
+	_branch->erase(_betas, i);
 	i--;
       }
     }
@@ -347,17 +301,18 @@ KETableau::KETableau(const string& id, SignedFormula *fml,
 
 KETableau::KETableau(const string& id, const vector<SignedFormula *>& fmls,
 		     KETableau *parent)
-  : Tableau(id, fmls, parent)
+  : Tableau(id, fmls, parent), _alphas(_branch->alphas),
+    _betas(_branch->betas), _lits(_branch->lits)
 {
   _closed = false;
-  
-  // Initialization of alphas, _betas and _lits
-  if (parent != NULL) {
-    _alphas.insert(_alphas.end(),
-		   parent->_alphas.begin(), parent->_alphas.end());    
-    _betas.insert(_betas.end(), parent->_betas.begin(), parent->_betas.end());
-    _lits.insert(_lits.end(), parent->_lits.begin(), parent->_lits.end());  
-  }
+  _learning = parent ? parent->_learning : false;
+  _backjumping = parent ? parent->_backjumping : false;
+  _level = parent ? parent->_level + 1 : 0;
+  _deps = NULL;
+  _transpositions = parent ? parent->_transpositions : NULL;
+  _pb = NULL;
+  _task = NULL;
+  _strategy2 = NULL;
 
   // Initialization of _rules
   _rules.push_back(&KE_alpha_E_NOT_OR);
@@ -382,7 +337,8 @@ KETableau::KETableau(const string& id, const vector<SignedFormula *>& fmls,
 void KETableau::setStrategy(KEStrategy *strategy) {
   // Initialization of the strategy object
   _strategy = strategy;
-  _strategy->init(_id, &_items, &_alphas, &_betas, &_lits);
+  PhaseTimer timer(_stats, Stats::INIT);
+  _strategy->init(_id, &_items, _branch);
 }
 
 bool KE_alpha_E_NOT_OR(const vector<SignedFormula *>& in,
@@ -392,9 +348,9 @@ bool KE_alpha_E_NOT_OR(const vector<SignedFormula *>& in,
 	 in[0]->formula && in[0]->formula->op == Formula::OR)) return false;
 
   out.push_back(new SignedFormula(SignedFormula::S_F,
-				  new Formula(*(in[0]->formula->left))));
+				  in[0]->formula->left));
   out.push_back(new SignedFormula(SignedFormula::S_F,
-				  new Formula(*(in[0]->formula->right))));
+				  in[0]->formula->right));
 
   return true;
 }
@@ -407,7 +363,7 @@ bool KE_alpha_E_NOT_ORN(const vector<SignedFormula *>& in,
 
   for(unsigned int i = 0; i < in[0]->formula->fmls.size(); i++)
     out.push_back(new SignedFormula(SignedFormula::S_F,
-				    new Formula(*(in[0]->formula->fmls[i]))));
+				    in[0]->formula->fmls[i]));
 
   return true;
 }
@@ -419,9 +375,9 @@ bool KE_alpha_E_AND(const vector<SignedFormula *>& in,
 	 in[0]->formula && in[0]->formula->op == Formula::AND)) return false;
 
   out.push_back(new SignedFormula(SignedFormula::S_T,
-				  new Formula(*(in[0]->formula->left))));
+				  in[0]->formula->left));
   out.push_back(new SignedFormula(SignedFormula::S_T,
-				  new Formula(*(in[0]->formula->right))));
+				  in[0]->formula->right));
 
   return true;
 }
@@ -434,7 +390,7 @@ bool KE_alpha_E_ANDN(const vector<SignedFormula *>& in,
 
   for(unsigned int i = 0; i < in[0]->formula->fmls.size(); i++)
     out.push_back(new SignedFormula(SignedFormula::S_T,
-				    new Formula(*(in[0]->formula->fmls[i]))));
+				    in[0]->formula->fmls[i]));
 
   return true;
 }
@@ -447,9 +403,9 @@ bool KE_alpha_E_NOT_IMPLIES(const vector<SignedFormula *>& in,
     return false;
 
   out.push_back(new SignedFormula(SignedFormula::S_T,
-				  new Formula(*(in[0]->formula->left))));
+				  in[0]->formula->left));
   out.push_back(new SignedFormula(SignedFormula::S_F,
-				  new Formula(*(in[0]->formula->right))));
+				  in[0]->formula->right));
 
   return true;
 }
@@ -461,7 +417,7 @@ bool KE_alpha_E_NOT_NOT(const vector<SignedFormula *>& in,
 	 in[0]->formula && in[0]->formula->op == Formula::NOT)) return false;
 
   out.push_back(new SignedFormula(SignedFormula::S_T,
-				  new Formula(*(in[0]->formula->right))));
+				  in[0]->formula->right));
 
   return true;
 }
@@ -473,7 +429,7 @@ bool KE_alpha_E_NOT(const vector<SignedFormula *>& in,
 	 in[0]->formula && in[0]->formula->op == Formula::NOT)) return false;
 
   out.push_back(new SignedFormula(SignedFormula::S_F,
-				  new Formula(*(in[0]->formula->right))));
+				  in[0]->formula->right));
 
   return true;
 }
@@ -490,11 +446,11 @@ bool KE_beta_E_OR_1(const vector<SignedFormula *>& in,
   if (! (primary && primary->sign == SignedFormula::S_T && 
 	 primary->formula->op == Formula::OR &&
 	 secondary && secondary->sign == SignedFormula::S_F &&
-	 primary->formula->left->toString() == secondary->formula->toString()))
+	 primary->formula->left->id == secondary->formula->id))
     return false;
 
   out.push_back(new SignedFormula(SignedFormula::S_T,
-				  new Formula(*(primary->formula->right))));
+				  primary->formula->right));
 
   return true;
 }
@@ -511,11 +467,11 @@ bool KE_beta_E_OR_2(const vector<SignedFormula *>& in,
   if (! (primary && primary->sign == SignedFormula::S_T &&
 	 primary->formula->op == Formula::OR &&
 	 secondary && secondary->sign == SignedFormula::S_F &&
-	 primary->formula->right->toString()==secondary->formula->toString()))
+	 primary->formula->right->id == secondary->formula->id))
     return false;
 
   out.push_back(new SignedFormula(SignedFormula::S_T,
-				  new Formula(*(primary->formula->left))));
+				  primary->formula->left));
 
   return true;
 }
@@ -536,8 +492,7 @@ bool KE_beta_E_ORN(const vector<SignedFormula *>& in,
     bool found = false;
     unsigned int i, ind;
     for (i = 0; ! found && i < primary->formula->fmls.size(); i++)
-      if (primary->formula->fmls[i]->toString() ==
-	  secondary->formula->toString()) {
+      if (primary->formula->fmls[i]->id == secondary->formula->id) {
 	found = true;
 	ind = i;
       }
@@ -547,11 +502,13 @@ bool KE_beta_E_ORN(const vector<SignedFormula *>& in,
 	  newfmls.push_back(primary->formula->fmls[i]);
       if (newfmls.size() > 2)
 	out.push_back(new SignedFormula(SignedFormula::S_T,
-					new Formula(Formula::ORN, newfmls)));
+					formulaFactory().make(Formula::ORN,
+							      newfmls)));
       else if (newfmls.size() == 2)
 	out.push_back(new SignedFormula(SignedFormula::S_T,
-					new Formula(Formula::OR, newfmls[0],
-						    newfmls[1])));
+					formulaFactory().make(Formula::OR,
+							      newfmls[0],
+							      newfmls[1])));
       else
 	out.push_back(new SignedFormula(SignedFormula::S_T, newfmls[0]));
       return true;
@@ -574,11 +531,11 @@ bool KE_beta_E_NOT_AND_1(const vector<SignedFormula *>& in,
   if (! (primary && primary->sign == SignedFormula::S_F &&
 	 primary->formula && primary->formula->op == Formula::AND &&
 	 secondary->sign == SignedFormula::S_T &&
-	 primary->formula->left->toString() == secondary->formula->toString()))
+	 primary->formula->left->id == secondary->formula->id))
     return false;
   
   out.push_back(new SignedFormula(SignedFormula::S_F,
-				  new Formula(*(primary->formula->right))));
+				  primary->formula->right));
   
   return true;
 }
@@ -595,11 +552,11 @@ bool KE_beta_E_NOT_AND_2(const vector<SignedFormula *>& in,
   if (! (primary && primary->sign == SignedFormula::S_F &&
 	 primary->formula && primary->formula->op == Formula::AND &&
 	 secondary->sign == SignedFormula::S_T &&
-	 primary->formula->right->toString()==secondary->formula->toString()))
+	 primary->formula->right->id == secondary->formula->id))
     return false;
   
   out.push_back(new SignedFormula(SignedFormula::S_F,
-				  new Formula(*(primary->formula->left))));
+				  primary->formula->left));
 
   return true;
 }
@@ -620,8 +577,7 @@ bool KE_beta_E_NOT_ANDN(const vector<SignedFormula *>& in,
     bool found = false;
     unsigned int i, ind;
     for (i = 0; ! found && i < primary->formula->fmls.size(); i++)
-      if (primary->formula->fmls[i]->toString() ==
-	  secondary->formula->toString()) {
+      if (primary->formula->fmls[i]->id == secondary->formula->id) {
 	found = true;
 	ind = i;
       }
@@ -631,11 +587,13 @@ bool KE_beta_E_NOT_ANDN(const vector<SignedFormula *>& in,
 	  newfmls.push_back(primary->formula->fmls[i]);
       if (newfmls.size() > 2)
 	out.push_back(new SignedFormula(SignedFormula::S_F,
-					new Formula(Formula::ANDN, newfmls)));
+					formulaFactory().make(Formula::ANDN,
+							      newfmls)));
       else if (newfmls.size() == 2)
 	out.push_back(new SignedFormula(SignedFormula::S_F,
-					new Formula(Formula::AND,
-						    newfmls[0], newfmls[1])));
+					formulaFactory().make(Formula::AND,
+							      newfmls[0],
+							      newfmls[1])));
       else
 	out.push_back(new SignedFormula(SignedFormula::S_F, newfmls[0]));
       return true;
@@ -657,11 +615,11 @@ bool KE_beta_E_IMPLIES_1(const vector<SignedFormula *>& in,
   if (! (primary && primary->sign == SignedFormula::S_T &&
 	 primary->formula->op == Formula::IMPLIES &&
 	 secondary->sign == SignedFormula::S_T &&
-	 primary->formula->left->toString() == secondary->formula->toString()))
+	 primary->formula->left->id == secondary->formula->id))
     return false;
 
   out.push_back(new SignedFormula(SignedFormula::S_T,
-				  new Formula(*(primary->formula->right))));
+				  primary->formula->right));
 
   return true;
 }
@@ -678,11 +636,11 @@ bool KE_beta_E_IMPLIES_2(const vector<SignedFormula *>& in,
   if (! (primary && primary->sign == SignedFormula::S_T &&
 	 primary->formula->op == Formula::IMPLIES &&
 	 secondary && secondary->sign == SignedFormula::S_F &&
-	 primary->formula->right->toString()==secondary->formula->toString()))
+	 primary->formula->right->id == secondary->formula->id))
     return false;
 
   out.push_back(new SignedFormula(SignedFormula::S_F,
-				  new Formula(*(primary->formula->left))));
+				  primary->formula->left));
 
   return true;
 }
@@ -698,7 +656,7 @@ bool KETableau::applyRule(KETableau::enumRule r,
   return result;
 }
 
-bool KETableau::close()
+KETableau::Step KETableau::expand()
 {
   preClose();
 
@@ -706,14 +664,14 @@ bool KETableau::close()
 
   if (_closed) {
     postClose();
-    return true;
+    return CLOSED;
   }
 
-  _closed = _strategy->classify(i);
+  _closed = classify(i);
   
   if (_closed) {
     postClose();
-    return true;
+    return CLOSED;
   }
 
   int nextRule = _strategy->nextRule();
@@ -725,26 +683,31 @@ bool KETableau::close()
 	unsigned int index = _strategy->chooseAlpha();
 	vector<SignedFormula *> in, out;
 	in.push_back(_alphas[index]);
+	{
+	  PhaseTimer timer(_stats, Stats::ALPHA);
+
+	  // exactly one of these will succeed
+	  bool success = false;
+	  success = success || applyRule(A_E_NOT_OR, in, out);
+	  success = success || applyRule(A_E_NOT_ORN, in, out);
+	  success = success || applyRule(A_E_AND, in, out);
+	  success = success || applyRule(A_E_ANDN, in, out);
+	  success = success || applyRule(A_E_NOT_IMPLIES, in, out);
+	  success = success || applyRule(A_E_NOT_NOT, in, out);
+	  success = success || applyRule(A_E_NOT, in, out);
+	  depend(in, out);
+
+	  _items.insert(_items.end(), out.begin(), out.end());
+	  //	cout << success << " " << index << " " << _alphas.size() << endl;
+	  _branch->erase(_alphas, index);
+	}
+	if (_stats != NULL)
+	  _stats->count(Stats::ALPHA_RULES);
 	
-	// exactly one of these will succeed
-	bool success = false;
-	success = success || applyRule(A_E_NOT_OR, in, out);
-	success = success || applyRule(A_E_NOT_ORN, in, out);
-	success = success || applyRule(A_E_AND, in, out);
-	success = success || applyRule(A_E_ANDN, in, out);
-	success = success || applyRule(A_E_NOT_IMPLIES, in, out);
-	success = success || applyRule(A_E_NOT_NOT, in, out);
-	success = success || applyRule(A_E_NOT, in, out);
-	
-	_items.insert(_items.end(), out.begin(), out.end());
-	//	cout << success << " " << index << " " << _alphas.size() << endl;
-	vector<SignedFormula *>::iterator it = _alphas.begin() + index;
-	_alphas.erase(it);
-	
-	_closed = _strategy->classify(i);
+	_closed = classify(i);
 	if (_closed) {
 	  postClose();
-	  return true;
+	  return CLOSED;
 	}
       }
       break;
@@ -756,69 +719,206 @@ bool KETableau::close()
 	
 	in.push_back(_betas[index]);
 	in.push_back(_lits[indexL]);
+	{
+	  PhaseTimer timer(_stats, Stats::BETA);
+
+	  // exactly one of these will succeed
+	  applyRule(B_E_OR_1, in, out);
+	  applyRule(B_E_OR_2, in, out);
+	  applyRule(B_E_ORN, in, out);
+	  applyRule(B_E_NOT_AND_1, in, out);
+	  applyRule(B_E_NOT_AND_2, in, out);
+	  applyRule(B_E_NOT_ANDN, in, out);
+	  applyRule(B_E_IMPLIES_1, in, out);
+	  applyRule(B_E_IMPLIES_2, in, out);
+	  depend(in, out);
+
+	  _items.insert(_items.end(), out.begin(), out.end());
+	  _branch->erase(_betas, index);
+	}
+	if (_stats != NULL)
+	  _stats->count(Stats::BETA_RULES);
 
-	// exactly one of these will succeed
-	applyRule(B_E_OR_1, in, out);
-	applyRule(B_E_OR_2, in, out);
-	applyRule(B_E_ORN, in, out);
-	applyRule(B_E_NOT_AND_1, in, out);
-	applyRule(B_E_NOT_AND_2, in, out);
-	applyRule(B_E_NOT_ANDN, in, out);
-	applyRule(B_E_IMPLIES_1, in, out);
-	applyRule(B_E_IMPLIES_2, in, out);
-	
-	_items.insert(_items.end(), out.begin(), out.end());
-	vector<SignedFormula *>::iterator it = _betas.begin() + index;
-	_betas.erase(it);
-
-	_closed = _strategy->classify(i);
+	_closed = classify(i);
 	if (_closed) {
 	  postClose();
-	  return true;
+	  return CLOSED;
 	}
       }
       break;
     case 2: // PB
       {
-	Formula *x = _strategy->choosePB();
+	// The same formulae were already found to close a branch. The
+	// decisions they depend on are unknown: assume all of them.
+	if (_transpositions != NULL &&
+	    _transpositions->lookup(_branch->hash(_keys), _keys)) {
+	  _closed = true;
+	  if (tracking())
+	    _deps = Dependencies::range(_level);
+	  postClose();
+	  return CLOSED;
+	}
+
+	{
+	  PhaseTimer timer(_stats, Stats::CHOOSE_PB);
+	  _pb = _strategy->choosePB();
+	}
 	
-	assert(x != NULL);
+	assert(_pb != NULL);
+	if (_stats != NULL)
+	  _stats->count(Stats::PB_RULES);
+	PhaseTimer timer(_stats, Stats::PB);
 	
 	// Obs: You cannot create the second child before the call to
 	// close() of the previous child. It leads to a sobreposition of
-	// the members of _strategy.
-	bool closed1, closed2;	
-	createChild(_id + "-1", new SignedFormula(SignedFormula::S_T, x));
-	closed1 = _children[0]->close();
-	setStrategy(_strategy);
-	if (closed1) {
-	  createChild(_id + "-2", new SignedFormula(SignedFormula::S_F, x));
-	  closed2 = _children[1]->close();
-	  setStrategy(_strategy);
-	}
-	if (closed1 && closed2) {
-	  //      cout << "CLOSED BRANCH " << _id << endl;
-	  postClose();
-	  return true;
-	}
-	else {
-	  postClose();
-	  return true;
+	// the members of _strategy. Unless some worker of the scheduler
+	// is idle: then the second child gets copies of the branch state
+	// and of the strategy, and is closed by that worker.
+	_mark = _branch->mark();
+	Scheduler *scheduler = Scheduler::current();
+	if (scheduler != NULL && scheduler->hungry()) {
+	  _strategy2 = _strategy->clone();
+	  BranchState *branch2 = new BranchState(*_branch);
+	  createChild(_id + "-1", decision(SignedFormula::S_T));
+	  KETableau *child2 =
+	    new KETableau(_id + "-2", decision(SignedFormula::S_F),
+			  this, branch2);
+	  child2->setStrategy(_strategy2);
+
+	  // child2 joins _children when it is done (see resume())
+	  _task = new CloseTask(child2);
+	  scheduler->spawn(_task);
 	}
+	else
+	  createChild(_id + "-1", decision(SignedFormula::S_T));
+	return SPLIT;
       }
       break;
     default:
       {
 	postClose();
-	return false;
+	return OPEN;
       }
     }
     nextRule = _strategy->nextRule();
   }
   postClose();
-  return false;
+  return OPEN;
+}
+
+KETableau::Step KETableau::resume(bool closed)
+{
+  _branch->undo(_mark);
+  setStrategy(_strategy);
+
+  // If the closure of the first child does not depend on its
+  // decision, the second child would close the same way
+  KETableau *first = (KETableau *) _children[0];
+  bool jump = closed && _backjumping && _children.size() == 1 &&
+    ! Dependencies::contains(first->_deps, _level);
+
+  if (_task != NULL) {
+    // The second child is closed by another worker, or by this one
+    // while joining
+    Scheduler::current()->join(_task);
+    _children.push_back(_task->tableau());
+    closed = closed && (jump || _task->closed);
+    delete _task;
+    delete _strategy2;
+    _task = NULL;
+    _strategy2 = NULL;
+  }
+  else if (closed && ! jump && _children.size() == 1) {
+    PhaseTimer timer(_stats, Stats::PB);
+    createChild(_id + "-2", decision(SignedFormula::S_F));
+    return SPLIT;
+  }
+
+  // The node depends on the decisions of its children but their own
+  if (closed && tracking()) {
+    if (jump)
+      _deps = first->_deps;
+    else {
+      _deps = NULL;
+      for (unsigned int c = 0; c < _children.size(); c++)
+	_deps = Dependencies::merge(_deps,
+	  Dependencies::remove(((KETableau *) _children[c])->_deps, _level));
+    }
+    if (_learning)
+      learn(_deps);
+  }
+
+  // Back at the state the PB rule was applied in
+  if (closed && _transpositions != NULL)
+    _transpositions->insert(_branch->hash(_keys), _keys);
+
+  //  if (closed) cout << "CLOSED BRANCH " << _id << endl;
+  postClose();
+  return closed ? CLOSED : OPEN;
+}
+
+bool KETableau::classify(unsigned int& index)
+{
+  PhaseTimer timer(_stats, Stats::CLASSIFY);
+  bool closed = _strategy->classify(index);
+  if (! tracking())
+    return closed;
+
+  // Adds the formulas following from the nogoods
+  while (! closed && _learning) {
+    SignedFormula *lemma;
+    closed = _branch->propagate(lemma);
+    if (lemma == NULL)
+      break;
+    _items.push_back(lemma);
+    closed = _strategy->classify(index);
+  }
+
+  if (closed)
+    _deps = _branch->conflict();
+  return closed;
 }
 
+SignedFormula *KETableau::decision(SignedFormula::Sign sign)
+{
+  SignedFormula *fml = new SignedFormula(sign, _pb);
+  if (tracking())
+    fml->deps = Dependencies::single(_level);
+  return fml;
+}
+
+void KETableau::depend(const vector<SignedFormula *>& in,
+		       vector<SignedFormula *>& out)
+{
+  if (! tracking())
+    return;
+
+  const Dependencies *deps = NULL;
+  for (unsigned int i = 0; i < in.size(); i++)
+    deps = Dependencies::merge(deps, in[i]->deps);
+  for (unsigned int i = 0; i < out.size(); i++)
+    out[i]->deps = deps;
+}
+
+void KETableau::learn(const Dependencies *deps)
+{
+  if (deps == NULL)
+    return;
+
+  // Every child is made by the PB rule, so the decision of level l
+  // is the first formula of the ancestor at depth l + 1
+  vector<SignedFormula *> nogood;
+  unsigned int j = deps->size;
+  for (KETableau *tab = this; tab != NULL && j > 0;
+       tab = (KETableau *) tab->_parent)
+    if (tab->_level == deps->levels[j-1] + 1) {
+      nogood.push_back(tab->_items[0]);
+      j--;
+    }
+  _branch->learn(nogood);
+}
+
+
 void KETableau::createChild(const string& id, SignedFormula *fml)
 {
   _children.push_back(new KETableau(id, fml, this));
@@ -73,18 +73,18 @@ class KEStrategy : public TableauStrategy
   // Returns the literal that goes as secondary of the chosen beta.
   virtual unsigned int chooseLit();
 
-  // Returns a pointer to a newly allocated formula on which the PB
-  // will be applied.
+  // Returns the formula on which the PB will be applied. It is a
+  // subformula of a beta, shared with it.
   virtual Formula *choosePB();
 
   // 0=alpha; 1=beta; 2=PB; -1=none.
   virtual int nextRule();
 
- protected:
-  // maps a formula to a tableau id if the formula has
-  // been applied in the tableau.
-  map<string, string> appliedPB;
+  // Returns a newly allocated copy of the strategy, used to close a
+  // branch in another thread.
+  virtual KEStrategy *clone() const;
 
+ protected:
   bool hasAppBeta;
   unsigned int indexAppBeta;
   unsigned int indexAppLit;
@@ -108,6 +108,8 @@ class KEValuationStrategy : public KEStrategy
   virtual ~KEValuationStrategy();
 
   virtual Formula *choosePB();
+
+  virtual KEStrategy *clone() const;
 };
 
 
@@ -131,6 +133,8 @@ class KEPolarityStrategy : public KEStrategy
   virtual ~KEPolarityStrategy();
 
   virtual Formula *choosePB();
+
+  virtual KEStrategy *clone() const;
 };
 
 
@@ -142,14 +146,30 @@ class KETableau : public Tableau
 {
  public:
   KETableau(const string& id, SignedFormula *fml,
-	    KETableau *parent = NULL);
+	    KETableau *parent = NULL, BranchState *branch = NULL);
   KETableau(const string& id, const vector<SignedFormula *>& fmls,
 	    KETableau *parent = NULL);
   ~KETableau() { }
 
   virtual void setStrategy(KEStrategy *strategy);
 
-  virtual bool close();
+  // Sets the learning mode, in which the tableau tracks the PB
+  // decisions each formula depends on. When a node is closed, the
+  // decisions its closure depends on are learned as a nogood, whose
+  // consequences are added to the other branches.
+  void setLearning(bool learning) { _learning = learning; }
+
+  // Sets the backjumping mode, in which the tableau tracks the PB
+  // decisions each formula depends on too. When the first child of a
+  // node is closed without depending on the decision of the node, the
+  // second child is not expanded: the same closure applies to it.
+  void setBackjumping(bool backjumping) { _backjumping = backjumping; }
+
+  // Sets the table of the branch states known to be closed (NULL for
+  // none). A node about to apply the PB rule in one of them is closed
+  // at once, and a node closed by its children adds its state to it.
+  void setTranspositions(TranspositionTable *table)
+  { _transpositions = table; }
 
  protected:
   enum enumRule {A_E_NOT_OR=0, A_E_NOT_ORN=1,
@@ -163,6 +183,30 @@ class KETableau : public Tableau
 			 vector<SignedFormula *>& in,
 			 vector<SignedFormula *>& out);
 
+  virtual Step expand();
+  virtual Step resume(bool closed);
+
+  // Returns true if the tableau tracks the dependencies of the
+  // formulae on the PB decisions.
+  bool tracking() const { return _learning || _backjumping; }
+
+  // Classifies the formulae of the node from index on, like the
+  // strategy, adding the formulae following from the nogoods in
+  // learning mode.
+  bool classify(unsigned int& index);
+
+  // Returns the formula of the PB rule applied in the node with the
+  // given sign, depending on the decision if tracking().
+  SignedFormula *decision(SignedFormula::Sign sign);
+
+  // Sets the dependencies of the conclusions of a rule, if
+  // tracking().
+  void depend(const vector<SignedFormula *>& in,
+	      vector<SignedFormula *>& out);
+
+  // Learns the decisions of the branch in deps as a nogood.
+  void learn(const Dependencies *deps);
+
   // Performs pre-close operations.
   virtual void preClose() { }
 
@@ -172,16 +216,37 @@ class KETableau : public Tableau
   // Create a child tableau.
   virtual void createChild(const string& id, SignedFormula *fml);
 
-  // Auxiliary vectors containing the alpha, the beta formulas and the
-  // literals in vector _items.
-  vector<SignedFormula *> _alphas, _betas, _lits;
+  // The alpha, the beta formulas and the literals of the branch, kept
+  // in _branch and shared with the parent and the children.
+  vector<SignedFormula *> &_alphas, &_betas, &_lits;
 
   // Indicates if the tableau is closed
   bool _closed;
 
+  // Learning and backjumping modes, the number of PB decisions above
+  // the node, and the decisions the closure of the node depends on.
+  bool _learning, _backjumping;
+  unsigned int _level;
+  const Dependencies *_deps;
+
+  // The table of closed branch states, shared by the whole tableau,
+  // and the keys of the state of the branch (see BranchState::hash()).
+  TranspositionTable *_transpositions;
+  vector<unsigned int> _keys;
+
+  // The formula of the PB rule applied in the node, and the mark of
+  // the branch state before its children.
+  Formula *_pb;
+  unsigned int _mark;
+
  private:
   // Strategy object
   KEStrategy *_strategy;
+
+  // The task closing the second child in another worker, and its
+  // strategy, if the children are closed in parallel.
+  CloseTask *_task;
+  KEStrategy *_strategy2;
 };
 
 #endif
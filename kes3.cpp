@@ -12,6 +12,29 @@
 #include "kes3.h"
 
 
+//////////////////////////////////////////////////////////////////////////////
+// Members of class ContextSet.
+//////////////////////////////////////////////////////////////////////////////
+
+void ContextSet::insert(unsigned int atom)
+{
+  if (atom >= _atoms.size())
+    _atoms.resize(atom + 1, false);
+  if (! _atoms[atom]) {
+    _atoms[atom] = true;
+    _log.push_back(atom);
+  }
+}
+
+set<string> ContextSet::names(unsigned int m) const
+{
+  set<string> names;
+  for (unsigned int i = 0; i < m && i < _log.size(); i++)
+    names.insert(formulaFactory().atomName(_log[i]));
+  return names;
+}
+
+
 //////////////////////////////////////////////////////////////////////////////
 // Members of class KES3Strategy.
 //////////////////////////////////////////////////////////////////////////////
@@ -24,15 +47,9 @@ Formula *KES3Strategy::choosePB()
 {
   unsigned int k, choice;
 
-  // Construct the valuation <atom, value>, with value in {*, 0, 1} (* = -1)
-  map<string, int> valuation;
-  for (k = 0; k < _lits->size(); k++)
-    if ((*_lits)[k]->type() == SignedFormula::LITERAL) {
-      if ((*_lits)[k]->sign == SignedFormula::S_F)
-	valuation[(*_lits)[k]->formula->atom] = 0;
-      else // S_T
-	valuation[(*_lits)[k]->formula->atom] = 1;
-    }
+  // Valuation <atom, value> of the branch, with value in {*, 0, 1} (* = -1)
+  const vector<int>& valuation = branchValuation();
+  const vector<int>& nearest = _branch->nearest(_atom_dist);
   
   // Check valuation against _betas. We'll choose the formula with the
   // lowest number of atoms not ocurring in S and with minimum
@@ -47,13 +64,11 @@ Formula *KES3Strategy::choosePB()
   minindv = minindp = indexAppPB;
   
   for (k = indexAppPB; k < _betas->size(); k++) {
-    map<string, string>::const_iterator it =
-      appliedPB.find((*_betas)[k]->toString());
-    if ((it == appliedPB.end()
-	 || it->second != id.substr(0, it->second.length())) &&
+    if (! _branch->appliedPB((*_betas)[k]) &&
 	(*_betas)[k]->value(valuation) < 1) {
-      unsigned int aovv = (*_betas)[k]->atomsOut(((KES3Tableau *)tab)->_S);
-      double dfv = (*_betas)[k]->distanceFrom(valuation, _atom_dist);
+      unsigned int aovv =
+	(*_betas)[k]->atomsOut(((KES3Tableau *)tab)->_S->atoms());
+      double dfv = (*_betas)[k]->distanceFrom(nearest);
       if (aovv < minv && dfv < mindv) {
 	minv = aovv;
 	minindv = k;
@@ -63,12 +78,12 @@ Formula *KES3Strategy::choosePB()
 	mindv = dfv;
 	minindv = k;
       }
-      for (map<string, int>::const_iterator vit = valuation.begin();
-	   vit != valuation.end(); vit++)
-	if ((*_betas)[k]->polarity(vit->first) == -vit->second) {
+      for (unsigned int a = 0; a < valuation.size(); a++)
+	if (valuation[a] != -1 &&
+	    (*_betas)[k]->polarity(a) == -valuation[a]) {
 	  unsigned int aovp =
-	    (*_betas)[k]->atomsOut(((KES3Tableau *)tab)->_S);
-	  double dfv = (*_betas)[k]->distanceFrom(valuation, _atom_dist);
+	    (*_betas)[k]->atomsOut(((KES3Tableau *)tab)->_S->atoms());
+	  double dfv = (*_betas)[k]->distanceFrom(nearest);
 	  if (aovp < minp && dfv < mindp) {
 	    minp = aovp;
 	    minindp = k;
@@ -78,6 +93,7 @@ Formula *KES3Strategy::choosePB()
 	    mindp = dfv;
 	    minindp = k;
 	  }
+	  break;
 	}
     }
   }
@@ -93,18 +109,18 @@ Formula *KES3Strategy::choosePB()
   case Formula::OR:
   case Formula::AND:
   case Formula::IMPLIES:
-    ret = new Formula(*((*_betas)[choice]->formula->left));
+    ret = (*_betas)[choice]->formula->left;
     break;
   case Formula::ORN:
   case Formula::ANDN:
-    ret = new Formula(*((*_betas)[choice]->formula->fmls[0]));
+    ret = (*_betas)[choice]->formula->fmls[0];
     break;
   default:
     ret =  NULL;
   }
 
   assert(ret != NULL);
-  appliedPB[(*_betas)[choice]->toString()] = id;
+  _branch->applyPB((*_betas)[choice]);
 
   // cout << "PB: " << ret->toString() << endl;
 
@@ -122,14 +138,15 @@ KES3AENOTLastStrategy::~KES3AENOTLastStrategy() { }
 bool KES3AENOTLastStrategy::hasApplicableSimpleAlpha()
 {
   for (unsigned int i = 0; i < _alphas->size(); i++) {
-    set<string>& Set = ((KES3Tableau *) tab)->_S;
+    const vector<bool>& Set = ((KES3Tableau *) tab)->_S->atoms();
     if (
 	(! ((*_alphas)[i]->sign == SignedFormula::S_T &&
 	    (*_alphas)[i]->formula->op == Formula::NOT))
 	||
 	(
 	 ((*_alphas)[i]->formula->right->op == Formula::ATOM) &&
-	 (Set.find(((*_alphas)[i]->formula->right->atom)) != Set.end())
+	 ((*_alphas)[i]->formula->right->atomId < Set.size()) &&
+	 Set[(*_alphas)[i]->formula->right->atomId]
 	)
        ) {
       indexAppAlpha = i;
@@ -143,15 +160,9 @@ bool KES3AENOTLastStrategy::hasApplicableSimpleAlpha()
 
 bool KES3AENOTLastStrategy::hasApplicableAENOT()
 {
-  // Construct the valuation <atom, value>, with value in {*, 0, 1} (* = -1)
-  map<string, int> valuation;
-  for (unsigned int k = 0; k < _lits->size(); k++)
-    if ((*_lits)[k]->type() == SignedFormula::LITERAL) {
-      if ((*_lits)[k]->sign == SignedFormula::S_F)
-	valuation[(*_lits)[k]->formula->atom] = 0;
-      else // S_T
-	valuation[(*_lits)[k]->formula->atom] = 1;
-    }
+  // The distances to the valuation of the branch are only needed to
+  // break ties.
+  const vector<int> *nearest = NULL;
   
   // We'll choose the formula with the lowest number of atoms outside
   // S and with minimum distance from the valuation given by the lits
@@ -164,7 +175,8 @@ bool KES3AENOTLastStrategy::hasApplicableAENOT()
   for (unsigned int i = 0; i < _alphas->size(); i++)
     if ((*_alphas)[i]->sign == SignedFormula::S_T &&
 	(*_alphas)[i]->formula->op == Formula::NOT) {
-      unsigned int aout = (*_alphas)[i]->atomsOut(((KES3Tableau *)tab)->_S);
+      unsigned int aout =
+	(*_alphas)[i]->atomsOut(((KES3Tableau *)tab)->_S->atoms());
       if (! hasAppAENOT) { // first time entering here
 	min = aout;
 	indexAppAlpha = i;
@@ -175,7 +187,9 @@ bool KES3AENOTLastStrategy::hasApplicableAENOT()
 	indexAppAlpha = i;
       }
       else if (aout == min) {
-  	double dist = (*_alphas)[i]->distanceFrom(valuation, _atom_dist);
+	if (nearest == NULL)
+	  nearest = &_branch->nearest(_atom_dist);
+  	double dist = (*_alphas)[i]->distanceFrom(*nearest);
   	if (dist < mind) {
   	  mind = dist;
 	  indexAppAlpha = i;
@@ -191,15 +205,9 @@ Formula *KES3AENOTLastStrategy::choosePB()
 {
   unsigned int k, choice;
 
-  // Construct the valuation <atom, value>, with value in {*, 0, 1} (* = -1)
-  map<string, int> valuation;
-  for (k = 0; k < _lits->size(); k++)
-    if ((*_lits)[k]->type() == SignedFormula::LITERAL) {
-      if ((*_lits)[k]->sign == SignedFormula::S_F)
-	valuation[(*_lits)[k]->formula->atom] = 0;
-      else // S_T
-	valuation[(*_lits)[k]->formula->atom] = 1;
-    }
+  // Valuation <atom, value> of the branch, with value in {*, 0, 1} (* = -1)
+  const vector<int>& valuation = branchValuation();
+  const vector<int>& nearest = _branch->nearest(_atom_dist);
   
   // Check valuation against _betas. We'll choose the formula with the
   // lowest number of atoms not ocurring in S and with minimum
@@ -214,13 +222,11 @@ Formula *KES3AENOTLastStrategy::choosePB()
   minindv = minindp = indexAppPB;
   
   for (k = indexAppPB; k < _betas->size(); k++) {
-    map<string, string>::const_iterator it =
-      appliedPB.find((*_betas)[k]->toString());
-    if ((it == appliedPB.end()
-	 || it->second != id.substr(0, it->second.length())) &&
+    if (! _branch->appliedPB((*_betas)[k]) &&
 	(*_betas)[k]->value(valuation) < 1) {
-      unsigned int aovv = (*_betas)[k]->atomsOut(((KES3Tableau *)tab)->_S);
-      double dfv = (*_betas)[k]->distanceFrom(valuation, _atom_dist);
+      unsigned int aovv =
+	(*_betas)[k]->atomsOut(((KES3Tableau *)tab)->_S->atoms());
+      double dfv = (*_betas)[k]->distanceFrom(nearest);
       if (aovv < minv && dfv < mindv) {
 	minv = aovv;
 	minindv = k;
@@ -230,12 +236,12 @@ Formula *KES3AENOTLastStrategy::choosePB()
 	mindv = dfv;
 	minindv = k;
       }
-      for (map<string, int>::const_iterator vit = valuation.begin();
-	   vit != valuation.end(); vit++)
-	if ((*_betas)[k]->polarity(vit->first) == -vit->second) {
+      for (unsigned int a = 0; a < valuation.size(); a++)
+	if (valuation[a] != -1 &&
+	    (*_betas)[k]->polarity(a) == -valuation[a]) {
 	  unsigned int aovp =
-	    (*_betas)[k]->atomsOut(((KES3Tableau *)tab)->_S);
-	  double dfv = (*_betas)[k]->distanceFrom(valuation, _atom_dist);
+	    (*_betas)[k]->atomsOut(((KES3Tableau *)tab)->_S->atoms());
+	  double dfv = (*_betas)[k]->distanceFrom(nearest);
 	  if (aovp < minp && dfv < mindp) {
 	    minp = aovp;
 	    minindp = k;
@@ -245,6 +251,7 @@ Formula *KES3AENOTLastStrategy::choosePB()
 	    mindp = dfv;
 	    minindp = k;
 	  }
+	  break;
 	}
     }
   }
@@ -260,18 +267,18 @@ Formula *KES3AENOTLastStrategy::choosePB()
   case Formula::OR:
   case Formula::AND:
   case Formula::IMPLIES:
-    ret = new Formula(*((*_betas)[choice]->formula->left));
+    ret = (*_betas)[choice]->formula->left;
     break;
   case Formula::ORN:
   case Formula::ANDN:
-    ret = new Formula(*((*_betas)[choice]->formula->fmls[0]));
+    ret = (*_betas)[choice]->formula->fmls[0];
     break;
   default:
     ret =  NULL;
   }
 
   assert(ret != NULL);
-  appliedPB[(*_betas)[choice]->toString()] = id;
+  _branch->applyPB((*_betas)[choice]);
 
   // cout << "PB: " << ret->toString() << endl;
 
@@ -290,19 +297,9 @@ int KES3AENOTLastStrategy::nextRule()
   }
   else if (! _betas->empty()) {
     unsigned int choice = 0;
-    while (choice < _betas->size()) {
-      map<string, string>::const_iterator it =
-	appliedPB.find((*_betas)[choice]->toString());
-      if (it != appliedPB.end()) {
-	//	cout << it->second << " | " << id << endl;
-	if (it->second == id.substr(0, it->second.length()))
-	  choice++;
-	else
-	  break;
-      }
-      else
-	break;
-    }
+    while (choice < _betas->size() &&
+	   _branch->appliedPB((*_betas)[choice]))
+      choice++;
     if (choice == _betas->size()) {
       if (hasApplicableAENOT()) {
 	//	cout << "AENot1: " << id << endl;
@@ -336,16 +333,29 @@ int KES3AENOTLastStrategy::nextRule()
 
 KES3Tableau::KES3Tableau(const string& id, SignedFormula *fml,
 			 KES3Tableau *parent)
-  : KETableau(id, fml, parent) { }
+  : KETableau(id, fml, parent)
+{
+  _S = parent ? parent->_S : new ContextSet();
+}
 
 KES3Tableau::KES3Tableau(const string& id, const vector<SignedFormula *>& fmls,
 			 KES3Tableau *parent)
-  : KETableau(id, fmls, parent) { }
+  : KETableau(id, fmls, parent)
+{
+  _S = parent ? parent->_S : new ContextSet();
+}
+
+KES3Tableau::~KES3Tableau()
+{
+  if (_parent == NULL)
+    delete _S;
+}
 
 void KES3Tableau::setStrategy(KES3Strategy *strategy) {
   // Initialization of the strategy object
   _strategy = strategy;
-  _strategy->init(_id, &_items, &_alphas, &_betas, &_lits);
+  PhaseTimer timer(_stats, Stats::INIT);
+  _strategy->init(_id, &_items, _branch);
   _strategy->setTableau(this);
 }
 
@@ -359,17 +369,17 @@ bool KES3Tableau::applyRule(KES3Tableau::enumRule r,
 
   if (result && r == A_E_NOT) {
       InsertAtoms(out[0]->formula);
-      mS[_items.size()-1] = _S;
+      mS[_items.size()-1] = _S->mark();
   }
   
   return result;
 }
 
-string KES3Tableau::toString(int level) const
+string KES3Tableau::nodeToString(int level) const
 {
   string s;
   unsigned int i;
-  map<unsigned int, set<string> >::const_iterator mit = mS.begin();
+  map<unsigned int, unsigned int>::const_iterator mit = mS.begin();
 
   for(i = 0; i < _items.size(); i++) {
     char si[11];
@@ -377,8 +387,9 @@ string KES3Tableau::toString(int level) const
     s += string(level, ' ') + si + " " + _items[i]->toString();
     if (mit != mS.end() && i == mit->first) {
       s += "   S = { ";
-      for (set<string>::const_iterator sit = mit->second.begin();
-	   sit != mit->second.end(); sit++)
+      set<string> names = _S->names(mit->second);
+      for (set<string>::const_iterator sit = names.begin();
+	   sit != names.end(); sit++)
 	s += (*sit) + " ";
       s += "}";
       mit++;
@@ -386,22 +397,10 @@ string KES3Tableau::toString(int level) const
     s += "\n";
   }
 
-  for (i = 0; i < _children.size(); i++)
-    if (_children[i] != NULL)
-      s += _children[i]->toString(level+2);
-
   return s;
 }
 
-void KES3Tableau::preClose()
-{
-  if (_parent) {
-    KES3Tableau *parent = (KES3Tableau *) _parent;
-    _S.insert(parent->_S.begin(), parent->_S.end());
-  }
-}
-
-bool KES3Tableau::close()
+KETableau::Step KES3Tableau::expand()
 {
   preClose();
 
@@ -410,15 +409,18 @@ bool KES3Tableau::close()
   if (_closed) {
     //    cout << "CLOSED BRANCH " << _id << endl;
     postClose();
-    return true;
+    return CLOSED;
   }
 
-  _closed = _strategy->classify(i);
+  {
+    PhaseTimer timer(_stats, Stats::CLASSIFY);
+    _closed = _strategy->classify(i);
+  }
   
   if (_closed) {
     //    cout << "CLOSED BRANCH " << _id << endl;
     postClose();
-    return true;
+    return CLOSED;
   }
 
   int nextRule = _strategy->nextRule();
@@ -433,26 +435,32 @@ bool KES3Tableau::close()
 
 	//	cout << toString() << endl;
 	//	cout << "alpha: " << _alphas[index]->toString() << endl;
-	
-	// exactly one of these will succeed
-	applyRule(A_E_NOT_OR, in, out);
-	applyRule(A_E_NOT_ORN, in, out);
-	applyRule(A_E_AND, in, out);
-	applyRule(A_E_ANDN, in, out);
-	applyRule(A_E_NOT_IMPLIES, in, out);
-	applyRule(A_E_NOT_NOT, in, out);
-	applyRule(A_E_NOT, in, out);
-	
-	_items.insert(_items.end(), out.begin(), out.end());
-	vector<SignedFormula *>::iterator it = _alphas.begin() + index;
-
-	_alphas.erase(it);
+	{
+	  PhaseTimer timer(_stats, Stats::ALPHA);
+
+	  // exactly one of these will succeed
+	  applyRule(A_E_NOT_OR, in, out);
+	  applyRule(A_E_NOT_ORN, in, out);
+	  applyRule(A_E_AND, in, out);
+	  applyRule(A_E_ANDN, in, out);
+	  applyRule(A_E_NOT_IMPLIES, in, out);
+	  applyRule(A_E_NOT_NOT, in, out);
+	  applyRule(A_E_NOT, in, out);
+
+	  _items.insert(_items.end(), out.begin(), out.end());
+	  _branch->erase(_alphas, index);
+	}
+	if (_stats != NULL)
+	  _stats->count(Stats::ALPHA_RULES);
 
-	_closed = _strategy->classify(i);
+	{
+	  PhaseTimer timer(_stats, Stats::CLASSIFY);
+	  _closed = _strategy->classify(i);
+	}
 	if (_closed) {
 	  //	  cout << "CLOSED BRANCH " << _id << endl;
 	  postClose();
-	  return true;
+	  return CLOSED;
 	}
       }
       break;
@@ -464,104 +472,109 @@ bool KES3Tableau::close()
 	
 	in.push_back(_betas[index]);
 	in.push_back(_lits[indexL]);
+	{
+	  PhaseTimer timer(_stats, Stats::BETA);
+
+	  // exactly one of these will succeed
+	  applyRule(B_E_OR_1, in, out);
+	  applyRule(B_E_OR_2, in, out);
+	  applyRule(B_E_ORN, in, out);
+	  applyRule(B_E_NOT_AND_1, in, out);
+	  applyRule(B_E_NOT_AND_2, in, out);
+	  applyRule(B_E_NOT_ANDN, in, out);
+	  applyRule(B_E_IMPLIES_1, in, out);
+	  applyRule(B_E_IMPLIES_2, in, out);
+
+	  _items.insert(_items.end(), out.begin(), out.end());
+	  _branch->erase(_betas, index);
+	}
+	if (_stats != NULL)
+	  _stats->count(Stats::BETA_RULES);
 
-	// exactly one of these will succeed
-	applyRule(B_E_OR_1, in, out);
-	applyRule(B_E_OR_2, in, out);
-	applyRule(B_E_ORN, in, out);
-	applyRule(B_E_NOT_AND_1, in, out);
-	applyRule(B_E_NOT_AND_2, in, out);
-	applyRule(B_E_NOT_ANDN, in, out);
-	applyRule(B_E_IMPLIES_1, in, out);
-	applyRule(B_E_IMPLIES_2, in, out);
-	
-	_items.insert(_items.end(), out.begin(), out.end());
-	vector<SignedFormula *>::iterator it = _betas.begin() + index;
-	_betas.erase(it);
-
-	_closed = _strategy->classify(i);
+	{
+	  PhaseTimer timer(_stats, Stats::CLASSIFY);
+	  _closed = _strategy->classify(i);
+	}
 	if (_closed) {
 	  //	  cout << "CLOSED BRANCH " << _id << endl;
 	  postClose();
-	  return true;
+	  return CLOSED;
 	}
       }
       break;
     case 2: // PB
       {
-	Formula *x = _strategy->choosePB();
+	{
+	  PhaseTimer timer(_stats, Stats::CHOOSE_PB);
+	  _pb = _strategy->choosePB();
+	}
 	
-	assert(x != NULL);
+	assert(_pb != NULL);
+	if (_stats != NULL)
+	  _stats->count(Stats::PB_RULES);
+	PhaseTimer timer(_stats, Stats::PB);
 	
 	// Obs: You cannot create the second child before the call to
 	// close() of the previous child. It leads to a sobreposition of
 	// the members of _strategy.
-	bool closed1, closed2;	
-	createChild(_id + "-1", new SignedFormula(SignedFormula::S_T, x));
-	closed1 = _children[0]->close();
-	setStrategy(_strategy);
-	if (closed1) {
-	  createChild(_id + "-2", new SignedFormula(SignedFormula::S_F, x));
-	  closed2 = _children[1]->close();
-	  setStrategy(_strategy);
-	}
-
-	if (closed1 && closed2) {
-	  //	  cout << "CLOSED BRANCH " << _id << endl;
-	  postClose();
-	  return true;
-	}
-	else {
-	  postClose();
-	  return false;
-	}
+	_mark = _branch->mark();
+	createChild(_id + "-1", new SignedFormula(SignedFormula::S_T, _pb));
+	return SPLIT;
       }
       break;
     default:
       {
 	postClose();
-	return false;
+	return OPEN;
       }
     }
     nextRule = _strategy->nextRule();
   }
   postClose();
-  return false;
+  return OPEN;
 }
 
-void KES3Tableau::postClose()
+KETableau::Step KES3Tableau::resume(bool closed)
 {
-  if (_parent) {
-    KES3Tableau *parent = (KES3Tableau *) _parent;
-    parent->_S.insert(_S.begin(), _S.end());
+  _branch->undo(_mark);
+  setStrategy(_strategy);
+
+  if (closed && _children.size() == 1) {
+    PhaseTimer timer(_stats, Stats::PB);
+    createChild(_id + "-2", new SignedFormula(SignedFormula::S_F, _pb));
+    return SPLIT;
   }
+
+  //  if (closed) cout << "CLOSED BRANCH " << _id << endl;
+  postClose();
+  return closed ? CLOSED : OPEN;
 }
 
 set<string> KES3Tableau::S() const
 {
-  return _S;
+  return _S->names(_S->mark());
 }
 
 void KES3Tableau::InsertAtoms(Formula *f)
 {
-  switch(f->op) {
-  case Formula::ANDN: case Formula::ORN:
-    {
-      for (unsigned int i = 0; i < f->fmls.size(); i++)
-	InsertAtoms(f->fmls[i]);
-    }
-    break;
-  case Formula::AND: case Formula::OR: case Formula::IMPLIES:
-    {
-      InsertAtoms(f->left);
-      InsertAtoms(f->right);
+  vector<Formula *> pending(1, f);
+  while (! pending.empty()) {
+    f = pending.back();
+    pending.pop_back();
+    switch(f->op) {
+    case Formula::ANDN: case Formula::ORN:
+      pending.insert(pending.end(), f->fmls.begin(), f->fmls.end());
+      break;
+    case Formula::AND: case Formula::OR: case Formula::IMPLIES:
+      pending.push_back(f->left);
+      pending.push_back(f->right);
+      break;
+    case Formula::NOT:
+      pending.push_back(f->right);
+      break;
+    case Formula::ATOM:
+      _S->insert(f->atomId);
     }
-    break;
-  case Formula::NOT:
-    InsertAtoms(f->right);
-    break;
-  case Formula::ATOM:
-    _S.insert(f->atom);
   }
 }
 
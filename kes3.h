@@ -16,6 +16,36 @@
 #include "ke.h"
 
 
+//////////////////////////////////////////////////////////////////////////////
+// Encapsulates the context set of atoms S of a KES3 tableau. A node
+// starts with the S of its parent, and gives its S back to the parent
+// when it is closed. Since the nodes are closed depth first, S only
+// grows, and a single set is shared by all the nodes of the tableau.
+// The atoms are also logged in insertion order, so the state of S at
+// any moment is identified by the size of the log.
+//////////////////////////////////////////////////////////////////////////////
+
+class ContextSet
+{
+ public:
+  // Inserts the atom with the specified id.
+  void insert(unsigned int atom);
+
+  // The atoms in S, indexed by atom id.
+  const vector<bool>& atoms() const { return _atoms; }
+
+  // Returns a mark identifying the current state of S.
+  unsigned int mark() const { return _log.size(); }
+
+  // Returns the names of the atoms in S when mark m was taken.
+  set<string> names(unsigned int m) const;
+
+ private:
+  vector<bool> _atoms;
+  vector<unsigned int> _log;
+};
+
+
 //////////////////////////////////////////////////////////////////////////////
 // Encapsulates the KES3 tableau default strategy. It:
 // - Analyses all the alphas first, top down;
@@ -95,15 +125,10 @@ class KES3Tableau : public KETableau
 	      KES3Tableau *parent = NULL);
   KES3Tableau(const string& id, const vector<SignedFormula *>& fmls,
 	      KES3Tableau *parent = NULL);
-  ~KES3Tableau() { }
+  ~KES3Tableau();
 
   virtual void setStrategy(KES3Strategy *strategy);
 
-  virtual bool close();
-
-  // Returns a string representation of the formula.
-  string toString(int level=0) const;
-  
   // Returns the current state of the context set S.
   set<string> S() const;
 
@@ -111,20 +136,21 @@ class KES3Tableau : public KETableau
   // constructor of the AENOTLast strategy. (Is this a case to use
   // friend classes?)
 
-  // The context set of atoms
-  // S.
-  set<string> _S;
+  // The context set of atoms S, shared with the parent and the
+  // children (owned by the root).
+  ContextSet *_S;
 
  protected:
   virtual bool applyRule(KETableau::enumRule r,
 			 vector<SignedFormula *>& in,
 			 vector<SignedFormula *>& out);
 
-  // Performs pre-close operations.
-  virtual void preClose();
+  virtual Step expand();
+  virtual Step resume(bool closed);
 
-  // Performs post-close operations.
-  virtual void postClose();
+  // Returns a string representation of the formulae of the node,
+  // with the state of S after each formula generated by T_NOT.
+  virtual string nodeToString(int level) const;
 
   // Inserts the atoms of formula f into the context set _S
   void InsertAtoms(Formula *f);
@@ -133,8 +159,8 @@ class KES3Tableau : public KETableau
   virtual void createChild(const string& id, SignedFormula *fml);
 
   // Associates each index of formula (generated by the T_NOT alpha
-  // rule) with the state of S generated by the rule.
-  map<unsigned int, set<string> > mS;
+  // rule) with the mark of the state of S generated by the rule.
+  map<unsigned int, unsigned int> mS;
 
  private:
   // The strategy object.
@@ -1,113 +1,758 @@
+#include <condition_variable>
 #include <cstdio>
 #include <cstdlib>
+#include <deque>
 #include <fstream>
 #include <iostream>
+#include <mutex>
+#include <sstream>
+#include <thread>
 
+#include <sys/resource.h>
 #include <sys/time.h>
 
 #include <cstring>
 
+#include "arena.h"
 #include "formula.h"
 #include "tableau.h"
 #include "analytic.h"
 #include "ke.h"
 #include "kes3.h"
+#include "reader.h"
+#include "scheduler.h"
+#include "stats.h"
 
 using namespace std;
 
 //
-// Usage: prove [-m analytic[+BU]*|ke[+V|P]|kes3[+PB]] [-v] -f file
+// Usage: prove [-m analytic[+BU]*|ke[+V|P]|kes3[+PB]|portfolio]...
+//              [-p method,...] [-j N] [-l] [-b] [-t MB]
+//              [-e lru*|fifo|replace] [-L limit=N,...] [-s json|csv]
+//              [-v] [-F list] [-f file]...
 //
 // * - default
 //
+// -j N closes the KE tableaux with N threads. The other methods
+// ignore it.
+//
+// -l makes the KE tableaux learn nogoods from their closed branches,
+// and -b makes them skip the second child of a PB rule when the first
+// child closes without depending on the rule. The other methods
+// ignore them.
+//
+// -t MB makes the KE tableaux remember the branch states found closed
+// in a transposition table of at most MB megabytes, and -e sets the
+// policy evicting its entries when it is full. The other methods
+// ignore them.
+//
+// -L limits the work of each proof, with a comma separated list of:
+// nodes=N (nodes expanded), formulae=N (formulae of those nodes),
+// mb=N (megabytes held by its arena) and s=N (seconds of wall time).
+// A proof exceeding a limit gives up, and its result is unknown: the
+// row ends with UNKNOWN and the limit, after the statistics of the
+// nodes expanded so far.
+//
+// -s json writes the result as a JSON object per line, and -s csv as
+// CSV lines after a header line, instead of the rows. Besides the
+// file, the method, the status (closed, open or unknown) and the
+// elapsed time, they hold the total time, the time of each phase of
+// the proof, the counters of the work done and the memory used (see
+// Stats). The elapsed time, as in the rows, is the time to close the
+// tableau, and does not include the setup of the strategy and of the
+// tableau (the init phase among others): the total time does.
+//
+// -m portfolio proves the problem with the methods listed in -p
+// (analytic,ke+P,kes3 by default) in parallel. The first one to
+// finish gives the result, and its name is added to the row; the
+// others are cancelled.
+//
+// Batch mode: with several -f files, files listed in -F list (one per
+// line, # starts a comment) or several -m methods, every file is read
+// once and proved with every method, by a pool of N threads (-j N):
+// N proofs run at once, each closing its tableau in a single thread.
+// Each result is printed as soon as it is ready, in a line starting
+// with the file and the method. A file that cannot be read, or holds
+// no formulas, gives an error line for each method.
+//
 
 void usage()
 {
-  cout << "Usage: prove [-m analytic[+BU]*|ke[+V|P]|kes3[+PB]] [-v] -f %.prove|%.cnf" << endl;
+  cout << "Usage: prove [-m analytic[+BU]*|ke[+V|P]|kes3[+PB]|portfolio]... [-p method,...] [-j N] [-l] [-b] [-t MB] [-e lru*|fifo|replace] [-L limit=N,...] [-s json|csv] [-v] [-F list] [-f %.prove|%.cnf]..." << endl;
   return;
 }
 
 
-bool readProve(const string& file, vector<SignedFormula *>& v)
+// Options of the proofs.
+struct Options
 {
-  string s_fml;
-  char sign;
-  Formula *p_fml;
-
-  ifstream in(file.c_str());
-
-  in >> sign;
-  in >> s_fml;
-  while (!in.eof()) {
-    p_fml = parse(s_fml);
-    if (p_fml) {
-      v.push_back(new SignedFormula(
-			sign=='T'?SignedFormula::S_T:SignedFormula::S_F,
-			p_fml));
-    }
-    else {
-      in.close();
+  bool verbose, learning, backjumping;
+  int jobs, tableMB;
+  TranspositionTable::Policy policy;
+
+  // The limits of the budget of each proof (0 for none).
+  unsigned long maxNodes, maxFormulae;
+  size_t maxBytes;
+  double maxSeconds;
+
+  // The format of the results.
+  enum Format {ROW, JSON, CSV} format;
+
+  // The methods of the portfolio method.
+  vector<string> portfolio;
+};
+
+
+// Returns true if m names a method (other than the portfolio).
+static bool isMethod(const string& m)
+{
+  return m == "analytic" || m == "analytic+BU" || m == "ke" ||
+    m == "ke+V" || m == "ke+P" || m == "kes3" || m == "kes3+PB";
+}
+
+
+// Sets the limits of opts given by list (see -L). Returns false if
+// list is malformed.
+static bool readLimits(const string& list, Options& opts)
+{
+  size_t start = 0, comma;
+  do {
+    comma = list.find(',', start);
+    string limit = list.substr(start, comma == string::npos ?
+			       string::npos : comma - start);
+    size_t eq = limit.find('=');
+    if (eq == string::npos)
+      return false;
+    string name = limit.substr(0, eq);
+    char *end;
+    double n = strtod(limit.c_str() + eq + 1, &end);
+    if (*end != '\0' || end == limit.c_str() + eq + 1 || n <= 0)
+      return false;
+
+    if (name == "nodes")
+      opts.maxNodes = (unsigned long) n;
+    else if (name == "formulae")
+      opts.maxFormulae = (unsigned long) n;
+    else if (name == "mb")
+      opts.maxBytes = (size_t) (n * (1 << 20));
+    else if (name == "s")
+      opts.maxSeconds = n;
+    else
       return false;
+    start = comma + 1;
+  } while (comma != string::npos);
+  return true;
+}
+
+
+// Returns true if the file has the extension ext.
+static bool hasExtension(const string& file, const string& ext)
+{
+  return file.size() > ext.size() &&
+    file.compare(file.size() - ext.size(), ext.size(), ext) == 0;
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+// A proof of a problem with a method: the tableau, allocated in the
+// current arena, its strategy, its transposition table and its budget
+// (if any).
+//////////////////////////////////////////////////////////////////////////////
+
+class Proof
+{
+ public:
+  Proof(const string& method, const vector<SignedFormula *>& v,
+	const Options& opts);
+  ~Proof();
+
+  // Writes the names of the fields of the results in CSV format.
+  static void writeCSVHeader(ostream& out);
+
+  // Closes the tableau, giving up when cancel is set (see
+  // Tableau::setCancel()) or when the budget is exceeded.
+  void run(const atomic<bool> *cancel = NULL);
+
+  // Returns the limit of the budget exceeded, or Budget::NONE.
+  Budget::Resource exceeded() const
+  { return _budget != NULL ? _budget->exceeded() : Budget::NONE; }
+
+  // Writes the result of the proof of file: the tableau and the
+  // statistics if verbose, and a row of a LaTeX table or a JSON or CSV
+  // record of the statistics.
+  void report(ostream& out, const string& file) const;
+
+  string method;
+  Tableau *tab;
+  bool closed;
+  char elapsed[20], total[20];
+  Stats stats;
+
+ private:
+  // Returns true for the KE methods.
+  bool ke() const
+  { return method.substr(0, 2) == "ke" && method.substr(0, 4) != "kes3"; }
+
+  // Returns closed, open or unknown.
+  const char *status() const
+  { return tab->cancelled() ? "unknown" : closed ? "closed" : "open"; }
+
+  // Writes the fields of the memory used by the proof.
+  void writeMemoryJSON(ostream& out) const;
+  void writeMemoryCSV(ostream& out) const;
+
+  const Options& _opts;
+  Arena *_arena;
+  struct timeval _setup;
+  TableauStrategy *_strategy;
+  TranspositionTable *_table;
+  Budget *_budget;
+};
+
+Proof::Proof(const string& m, const vector<SignedFormula *>& v,
+	     const Options& opts)
+  : method(m), closed(false), stats(opts.format != Options::ROW),
+    _opts(opts), _arena(Arena::current())
+{
+  struct timeval startt, endt;
+  gettimeofday(&startt, NULL);
+
+  // The transposition table outlives the tableau using it
+  _table = NULL;
+  _budget = NULL;
+  if (opts.tableMB > 0)
+    _table = new TranspositionTable((size_t) opts.tableMB << 20, opts.policy);
+
+  if (method.substr(0, 8) == "analytic") {
+    AnalyticStrategy *s;
+    if (method == "analytic+BU")
+      s = new AnalyticBottomUpStrategy();
+    else
+      s = new AnalyticStrategy();
+    tab = new AnalyticTableau("1", v);
+    tab->setStats(&stats);
+    ((AnalyticTableau *) tab)->setStrategy(s);
+    _strategy = s;
+  }
+  else if (method.substr(0, 4) == "kes3") {
+    KES3Strategy *s;
+    if (method == "kes3+PB")
+      s = new KES3AENOTLastStrategy();
+    else
+      s = new KES3Strategy();
+    tab = new KES3Tableau("1", v);
+    tab->setStats(&stats);
+    ((KES3Tableau *) tab)->setStrategy(s);
+    _strategy = s;
+  }
+  else {
+    KEStrategy *s;
+    if (method == "ke")
+      s = new KEStrategy();
+    else if (method == "ke+V")
+      s = new KEValuationStrategy();
+    else // ke+P
+      s = new KEPolarityStrategy();
+    tab = new KETableau("1", v);
+    tab->setStats(&stats);
+    ((KETableau *) tab)->setLearning(opts.learning);
+    ((KETableau *) tab)->setBackjumping(opts.backjumping);
+    ((KETableau *) tab)->setTranspositions(_table);
+    ((KETableau *) tab)->setStrategy(s);
+    _strategy = s;
+  }
+  elapsed[0] = total[0] = '\0';
+
+  gettimeofday(&endt, NULL);
+  timersub(&endt, &startt, &_setup);
+}
+
+Proof::~Proof()
+{
+  delete _strategy;
+  delete _table;
+  delete _budget;
+}
+
+void Proof::run(const atomic<bool> *cancel)
+{
+  struct timeval startt, endt;
+
+  tab->setCancel(cancel);
+  if (_opts.maxNodes > 0 || _opts.maxFormulae > 0 ||
+      _opts.maxBytes > 0 || _opts.maxSeconds > 0) {
+    _budget = new Budget(_opts.maxNodes, _opts.maxFormulae,
+			 _opts.maxBytes, _opts.maxSeconds);
+    tab->setBudget(_budget);
+  }
+  gettimeofday(&startt, NULL);
+
+  // The proofs of a batch have a single job (see Batch)
+  if (_opts.jobs > 1 && ke()) {
+    Scheduler scheduler(_opts.jobs);
+    CloseTask task(tab);
+    scheduler.run(&task);
+    closed = task.closed;
+  }
+  else
+    closed = tab->close();
+
+  gettimeofday(&endt, NULL);
+
+  struct timeval closing, all;
+  timersub(&endt, &startt, &closing);
+  timeradd(&closing, &_setup, &all);
+  sprintf(elapsed, "%ld.%06ld", (long) closing.tv_sec, (long) closing.tv_usec);
+  sprintf(total, "%ld.%06ld", (long) all.tv_sec, (long) all.tv_usec);
+}
+
+void Proof::writeCSVHeader(ostream& out)
+{
+  out << "file,method,status,elapsed,total,";
+  Stats::writeCSVHeader(out);
+  out << ",arena_bytes,allocations,peak_rss_kb";
+}
+
+// Writes s as a JSON string.
+static void writeJSONString(ostream& out, const string& s)
+{
+  out << '"';
+  for (unsigned int i = 0; i < s.size(); i++) {
+    if (s[i] == '"' || s[i] == '\\')
+      out << '\\';
+    out << s[i];
+  }
+  out << '"';
+}
+
+// Returns the peak resident set size of the process, in kilobytes.
+static long peakRSS()
+{
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss;
+}
+
+void Proof::writeMemoryJSON(ostream& out) const
+{
+  out << "\"arena_bytes\":" << (_arena ? _arena->bytes() : 0)
+      << ",\"allocations\":" << (_arena ? _arena->allocations() : 0)
+      << ",\"peak_rss_kb\":" << peakRSS();
+}
+
+void Proof::writeMemoryCSV(ostream& out) const
+{
+  out << (_arena ? _arena->bytes() : 0) << ","
+      << (_arena ? _arena->allocations() : 0) << "," << peakRSS();
+}
+
+void Proof::report(ostream& out, const string& file) const
+{
+  if (_opts.verbose) {
+    if (closed)
+      out << tab->toString() << "x" << endl;
+    else
+      out << tab->toString() << endl;
+
+    out << endl
+	<< "Total number of nodes:    " << stats.get(Stats::NODES) << endl
+	<< "Total number of formulae: " << stats.get(Stats::FORMULAE) << endl
+	<< "Elapsed time (s):         " << elapsed << endl;
+    if (_table != NULL && ke())
+      out << "Transposition hits:       " << _table->hits() << endl;
+    if (exceeded() != Budget::NONE)
+      out << "Result:                   unknown (" << Budget::name(exceeded())
+	  << " limit exceeded)" << endl;
+  }
+
+  if (_opts.format == Options::JSON) {
+    out << "{\"file\":";
+    writeJSONString(out, file);
+    out << ",\"method\":";
+    writeJSONString(out, method);
+    out << ",\"status\":\"" << status() << "\",\"elapsed\":" << elapsed
+	<< ",\"total\":" << total << ",";
+    stats.writeJSON(out);
+    out << ",";
+    writeMemoryJSON(out);
+    out << "}";
+  }
+  else if (_opts.format == Options::CSV) {
+    out << file << "," << method << "," << status() << "," << elapsed << ","
+	<< total << ",";
+    stats.writeCSV(out);
+    out << ",";
+    writeMemoryCSV(out);
+  }
+  else if (! _opts.verbose) {
+    out //<< (closed ? 1 : 0) << "\t"
+	<< stats.get(Stats::NODES) << " & "
+	<< stats.get(Stats::FORMULAE) << " & "
+	<< elapsed << " & ";
+    if (method.substr(0, 4) == "kes3")
+      out << ((KES3Tableau *) tab)->S().size() << " & ";//endl;
+    else
+      out << " & ";//endl;
+    if (exceeded() != Budget::NONE)
+      out << "UNKNOWN " << Budget::name(exceeded()) << " ";
+  }
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+// A member of a portfolio: proves the problem with its method in its
+// own thread and arena, sharing the formulas of the problem with the
+// other members. The first member to finish cancels the others.
+//////////////////////////////////////////////////////////////////////////////
+
+class Racer
+{
+ public:
+  Racer(const string& method, const vector<SignedFormula *>& v,
+	const Options& opts, atomic<bool> *done, Racer **winner,
+	mutex *lock)
+    : _method(method), _v(v), _opts(opts), _factory(&formulaFactory()),
+      _done(done), _winner(winner), _lock(lock), _proof(NULL) { }
+  ~Racer() { delete _proof; }
+
+  void run();
+
+  // The proof, once run() returns.
+  Proof& proof() const { return *_proof; }
+
+ private:
+  string _method;
+  const vector<SignedFormula *>& _v;
+  const Options& _opts;
+  FormulaFactory *_factory;
+  atomic<bool> *_done;
+  Racer **_winner;
+  mutex *_lock;
+
+  Arena _arena;
+  Proof *_proof;
+};
+
+void Racer::run()
+{
+  ArenaScope scope(&_arena);
+  FactoryScope factory(_factory);
+
+  // Own copies of the signed formulas, for the tableau to annotate
+  vector<SignedFormula *> v;
+  for (unsigned int i = 0; i < _v.size(); i++)
+    v.push_back(new SignedFormula(_v[i]->sign, _v[i]->formula));
+
+  _proof = new Proof(_method, v, _opts);
+  _proof->run(_done);
+  if (_proof->tab->cancelled())
+    return;
+
+  lock_guard<mutex> guard(*_lock);
+  if (*_winner == NULL) {
+    *_winner = this;
+    _done->store(true);
+  }
+}
+
+
+// Reads the problem in file into v, in the current factory and arena,
+// setting parse to the time it took, in nanoseconds. Returns false,
+// writing the error to err, if the file cannot be read or holds no
+// formulas, as a tableau needs one to start from.
+static bool readProblem(const string& file, vector<SignedFormula *>& v,
+			unsigned long long& parse, ostream& err)
+{
+  ParseStatus status;
+  chrono::steady_clock::time_point start = chrono::steady_clock::now();
+  if (hasExtension(file, ".cnf"))
+    status = readCNF(file, v);
+  else
+    status = readProve(file, v);
+  parse = chrono::duration_cast<chrono::nanoseconds>(
+    chrono::steady_clock::now() - start).count();
+  if (! status.ok()) {
+    err << file << ":" << status.offset << ": " << status.message();
+    return false;
+  }
+  if (v.empty()) {
+    err << file << ": no formulas";
+    return false;
+  }
+  return true;
+}
+
+
+// Proves the problem v of file with method, writing the result to
+// out. The tableau nodes of the proof are built in the current arena,
+// and the formulas in the current factory.
+//
+// The portfolio method runs the methods of opts.portfolio at the
+// same time, and reports the result of the first one to finish,
+// followed by its name. If they all exceed their budgets, it reports
+// the first one.
+static void proveProblem(const string& file, const string& method,
+			 const vector<SignedFormula *>& v,
+			 unsigned long long parse, const Options& opts,
+			 ostream& out)
+{
+  if (method != "portfolio") {
+    Proof proof(method, v, opts);
+    if (opts.verbose) {
+      out << endl;
+      out << proof.tab->toString() << endl;
+      out << "-------------------------------" << endl << endl;
     }
-    in >> sign;
-    in >> s_fml;
+    proof.stats.addTime(Stats::PARSE, parse);
+    proof.run();
+    proof.report(out, file);
+    return;
   }
-  in.close();
+
+  atomic<bool> done(false);
+  Racer *winner = NULL;
+  mutex lock;
+
+  vector<Racer *> racers;
+  vector<thread> threads;
+  for (unsigned int i = 0; i < opts.portfolio.size(); i++)
+    racers.push_back(new Racer(opts.portfolio[i], v, opts,
+			       &done, &winner, &lock));
+  for (unsigned int i = 0; i < racers.size(); i++)
+    threads.push_back(thread(&Racer::run, racers[i]));
+  for (unsigned int i = 0; i < threads.size(); i++)
+    threads[i].join();
+
+  if (winner == NULL)
+    winner = racers[0];
+  winner->proof().stats.addTime(Stats::PARSE, parse);
+  winner->proof().report(out, file);
+  if (opts.verbose)
+    out << "Method:                   " << winner->proof().method << endl;
+  else if (opts.format == Options::ROW)
+    out << winner->proof().method;
+
+  for (unsigned int i = 0; i < racers.size(); i++)
+    delete racers[i];
+}
+
+
+// Proves the problem in file with method, writing the result to out.
+// The formulas, the signed formulas and the tableau nodes of the
+// proof are built in its own factory and arena, and released all at
+// once at the end. Returns false, writing the error to err, if the
+// file cannot be read or holds no formulas.
+bool prove(const string& file, const string& method, const Options& opts,
+	   ostream& out, ostream& err)
+{
+  FormulaFactory factory;
+  FactoryScope factoryScope(&factory);
+  Arena arena;
+  ArenaScope scope(&arena);
+
+  vector<SignedFormula *> v;
+  unsigned long long parse;
+  if (! readProblem(file, v, parse, err))
+    return false;
+  proveProblem(file, method, v, parse, opts, out);
   return true;
 }
 
 
-// Assumes:
-// - lines with less than (or) 256 characters
-// - each clause occurs in a line
+//////////////////////////////////////////////////////////////////////////////
+// Proves every file with every method in batch mode, with a pool of
+// threads taking jobs from a queue. A job reads a file, once, into a
+// factory and an arena of its own, and queues a job for each method,
+// which proves the problem in an arena of its own, sharing the
+// formulas. The proof jobs go first, so the problems read are proved
+// and released before more are read. The pool is not the scheduler
+// of the KE tableaux: each proof closes its tableau alone, so its
+// elapsed time and its budget are its own.
+//////////////////////////////////////////////////////////////////////////////
 
-bool readCNF(const string& file, vector<SignedFormula *>& v)
+class Batch
 {
-  ifstream in(file.c_str());
-  char buffer[256];
-  string line;
+ public:
+  Batch(const vector<string>& files, const vector<string>& methods,
+	const Options& opts);
+
+  // Runs the jobs with n threads, including the calling one.
+  void run(unsigned int n);
+
+ private:
+  // A problem read, with its factory and arena, released by the last
+  // of its proofs.
+  struct Problem {
+    string file;
+    FormulaFactory factory;
+    Arena arena;
+    vector<SignedFormula *> v;
+    unsigned long long parse;
+    atomic<unsigned int> proofs;
+  };
+
+  // Reads file (if problem is NULL) or proves problem with method.
+  struct Job {
+    string file;
+    Problem *problem;
+    string method;
+  };
+
+  // Runs jobs until there is none left.
+  void work();
+
+  void read(const string& file);
+  void prove(Problem *problem, const string& method);
 
-  int vars, clauses, cl=0;
+  // Prints the result of the proof of file with method, or the error.
+  void print(const string& file, const string& method, bool ok,
+	     const string& out, const string& err);
 
-  while (! in.eof() && cl != clauses) {
-    in.getline(buffer, 256);
-    if (buffer[0] == 'c') // comment line
+  const vector<string>& _methods;
+  Options _opts;
+
+  // The jobs, and the number of jobs running, which may queue more.
+  deque<Job> _jobs;
+  unsigned int _running;
+  mutex _lock;
+  condition_variable _changed;
+
+  mutex _printing;
+};
+
+Batch::Batch(const vector<string>& files, const vector<string>& methods,
+	     const Options& opts)
+  : _methods(methods), _opts(opts), _running(0)
+{
+  _opts.jobs = 1;
+  for (unsigned int f = 0; f < files.size(); f++) {
+    Job job;
+    job.file = files[f];
+    job.problem = NULL;
+    _jobs.push_back(job);
+  }
+}
+
+void Batch::run(unsigned int n)
+{
+  vector<thread> threads;
+  for (unsigned int i = 1; i < n; i++)
+    threads.push_back(thread(&Batch::work, this));
+  work();
+  for (unsigned int i = 0; i < threads.size(); i++)
+    threads[i].join();
+}
+
+void Batch::work()
+{
+  unique_lock<mutex> guard(_lock);
+  while (true) {
+    while (_jobs.empty() && _running > 0)
+      _changed.wait(guard);
+    if (_jobs.empty())
+      return;
+
+    Job job = _jobs.front();
+    _jobs.pop_front();
+    _running++;
+    guard.unlock();
+
+    if (job.problem == NULL)
+      read(job.file);
+    else
+      prove(job.problem, job.method);
+
+    guard.lock();
+    _running--;
+    _changed.notify_all();
+  }
+}
+
+void Batch::read(const string& file)
+{
+  Problem *problem = new Problem();
+  problem->file = file;
+  problem->proofs = _methods.size();
+
+  ostringstream err;
+  bool ok;
+  {
+    FactoryScope factory(&problem->factory);
+    ArenaScope scope(&problem->arena);
+    ok = readProblem(file, problem->v, problem->parse, err);
+  }
+  if (! ok) {
+    for (unsigned int m = 0; m < _methods.size(); m++)
+      print(file, _methods[m], false, "", err.str());
+    delete problem;
+    return;
+  }
+
+  lock_guard<mutex> guard(_lock);
+  for (unsigned int m = _methods.size(); m > 0; m--) {
+    Job job;
+    job.problem = problem;
+    job.method = _methods[m-1];
+    _jobs.push_front(job);
+  }
+  _changed.notify_all();
+}
+
+void Batch::prove(Problem *problem, const string& method)
+{
+  ostringstream out;
+  {
+    FactoryScope factory(&problem->factory);
+    Arena arena;
+    ArenaScope scope(&arena);
+
+    // Own copies of the signed formulas, for the tableau to annotate
+    vector<SignedFormula *> v;
+    for (unsigned int i = 0; i < problem->v.size(); i++)
+      v.push_back(new SignedFormula(problem->v[i]->sign,
+				    problem->v[i]->formula));
+    proveProblem(problem->file, method, v, problem->parse, _opts, out);
+  }
+  print(problem->file, method, true, out.str(), "");
+
+  if (--problem->proofs == 0)
+    delete problem;
+}
+
+void Batch::print(const string& file, const string& method, bool ok,
+		  const string& out, const string& err)
+{
+  // The JSON and CSV records hold the file and the method
+  lock_guard<mutex> guard(_printing);
+  if (ok && _opts.format != Options::ROW)
+    cout << out << endl;
+  else if (ok)
+    cout << file << " " << method << " " << out << endl;
+  else if (_opts.format != Options::ROW)
+    cerr << "prove: " << err << endl;
+  else
+    cout << file << " " << method << " error: " << err << endl;
+}
+
+
+// Appends to files the files listed in list, one per line. Returns
+// false if list cannot be read.
+bool readList(const string& list, vector<string>& files)
+{
+  ifstream in(list.c_str());
+  if (! in)
+    return false;
+
+  string line;
+  while (getline(in, line)) {
+    size_t comment = line.find('#');
+    if (comment != string::npos)
+      line.erase(comment);
+    size_t first = line.find_first_not_of(" \t\r");
+    if (first == string::npos)
       continue;
-    else if (buffer[0] == 'p') // problem line
-      sscanf(buffer, "p cnf %d %d\n", &vars, &clauses);
-    else { // clause line
-      vector<int> vv;
-      int n;
-      char *sn = strtok(buffer, " \t");
-      n = atoi(sn);
-      vv.push_back(n);
-      while (n != 0) {
-	sn = strtok(NULL, " \t");
-	n = atoi(sn);
-	if (n != 0) vv.push_back(n);
-      }
-      Formula *fml = NULL;
-      for (unsigned int i = 0; i < vv.size(); i++) {
-	sprintf(buffer, "x%d", abs(vv[i]));
-	if (fml == NULL) {
-	  if (vv[i] > 0)
-	    fml = new Formula(string(buffer));
-	  else
-	    fml = new Formula(Formula::NOT, new Formula(string(buffer)));
-	}
-	else {
-	  if (vv[i] > 0)
-	    fml = new Formula(Formula::OR, fml, new Formula(string(buffer)));
-	  else
-	    fml = new Formula(Formula::OR,
-			      fml,
-			      new Formula(Formula::NOT,
-					  new Formula(string(buffer))));
-	}
-      }
-      v.push_back(new SignedFormula(SignedFormula::S_T, fml));
-      cl++;
-    }
+    size_t last = line.find_last_not_of(" \t\r");
+    files.push_back(line.substr(first, last - first + 1));
   }
   return true;
 }
@@ -115,37 +760,113 @@ bool readCNF(const string& file, vector<SignedFormula *>& v)
 
 int main(int argc, char **argv)
 {
-  string method = "analytic", file = "";
-  bool syntax = false, verbose = false, cnf = false;
+  vector<string> methods, files, lists;
+  bool syntax = false;
   int arg;
-  
+  Options opts;
+  opts.verbose = opts.learning = opts.backjumping = false;
+  opts.jobs = 1;
+  opts.tableMB = 0;
+  opts.policy = TranspositionTable::LRU;
+  opts.maxNodes = opts.maxFormulae = 0;
+  opts.maxBytes = 0;
+  opts.maxSeconds = 0;
+  opts.format = Options::ROW;
+  opts.portfolio.push_back("analytic");
+  opts.portfolio.push_back("ke+P");
+  opts.portfolio.push_back("kes3");
+
   for (arg = 1; ! syntax && arg < argc; arg++) {
     if (strcmp(argv[arg], "-v") == 0)
-      verbose = true;
+      opts.verbose = true;
     else if (strcmp(argv[arg], "-m") == 0) {
-      if (arg+1 < argc && 
-	  (strcmp(argv[arg+1], "analytic") == 0 ||
-	   strcmp(argv[arg+1], "analytic+BU") == 0 ||
-	   strcmp(argv[arg+1], "ke") == 0 ||
-	   strcmp(argv[arg+1], "ke+V") == 0 ||
-	   strcmp(argv[arg+1], "ke+P") == 0 ||
-	   strcmp(argv[arg+1], "kes3") == 0 ||
-	   strcmp(argv[arg+1], "kes3+PB") == 0)) {
-	method = argv[arg+1];
+      if (arg+1 < argc &&
+	  (isMethod(argv[arg+1]) || strcmp(argv[arg+1], "portfolio") == 0)) {
+	methods.push_back(argv[arg+1]);
 	arg++;
       }
       else
 	syntax = true;
     }
+    else if (strcmp(argv[arg], "-p") == 0) {
+      if (arg+1 < argc) {
+	opts.portfolio.clear();
+	string list = argv[arg+1];
+	size_t start = 0, comma;
+	do {
+	  comma = list.find(',', start);
+	  string m = list.substr(start, comma == string::npos ?
+				 string::npos : comma - start);
+	  if (isMethod(m))
+	    opts.portfolio.push_back(m);
+	  else
+	    syntax = true;
+	  start = comma + 1;
+	} while (comma != string::npos);
+	arg++;
+      }
+      else
+	syntax = true;
+    }
+    else if (strcmp(argv[arg], "-j") == 0) {
+      if (arg+1 < argc && atoi(argv[arg+1]) > 0) {
+	opts.jobs = atoi(argv[arg+1]);
+	arg++;
+      }
+      else
+	syntax = true;
+    }
+    else if (strcmp(argv[arg], "-l") == 0)
+      opts.learning = true;
+    else if (strcmp(argv[arg], "-b") == 0)
+      opts.backjumping = true;
+    else if (strcmp(argv[arg], "-t") == 0) {
+      if (arg+1 < argc && atoi(argv[arg+1]) > 0) {
+	opts.tableMB = atoi(argv[arg+1]);
+	arg++;
+      }
+      else
+	syntax = true;
+    }
+    else if (strcmp(argv[arg], "-e") == 0) {
+      if (arg+1 < argc && strcmp(argv[arg+1], "lru") == 0)
+	opts.policy = TranspositionTable::LRU;
+      else if (arg+1 < argc && strcmp(argv[arg+1], "fifo") == 0)
+	opts.policy = TranspositionTable::FIFO;
+      else if (arg+1 < argc && strcmp(argv[arg+1], "replace") == 0)
+	opts.policy = TranspositionTable::REPLACE;
+      else
+	syntax = true;
+      arg++;
+    }
+    else if (strcmp(argv[arg], "-L") == 0) {
+      if (arg+1 < argc && readLimits(argv[arg+1], opts))
+	arg++;
+      else
+	syntax = true;
+    }
+    else if (strcmp(argv[arg], "-s") == 0) {
+      if (arg+1 < argc && strcmp(argv[arg+1], "json") == 0)
+	opts.format = Options::JSON;
+      else if (arg+1 < argc && strcmp(argv[arg+1], "csv") == 0)
+	opts.format = Options::CSV;
+      else
+	syntax = true;
+      arg++;
+    }
     else if (strcmp(argv[arg], "-f") == 0) {
+      if (arg+1 < argc &&
+	  (hasExtension(argv[arg+1], ".cnf") ||
+	   hasExtension(argv[arg+1], ".prove"))) {
+	files.push_back(argv[arg+1]);
+	arg++;
+      }
+      else
+	syntax = true;
+    }
+    else if (strcmp(argv[arg], "-F") == 0) {
       if (arg+1 < argc) {
-	file = argv[arg+1];
-	if (file.size() > 4 && file.substr(file.size()-4, 4) == ".cnf")
-	  cnf = true;
-	else if (file.size() > 5 && file.substr(file.size()-6, 6) == ".prove")
-	  cnf = false;
-	else
-	  syntax = true;
+	lists.push_back(argv[arg+1]);
 	arg++;
       }
       else
@@ -154,104 +875,39 @@ int main(int argc, char **argv)
     else
       syntax = true;
   }
-  
-  if (file == "")
+
+  if (files.empty() && lists.empty())
     syntax = true;
-  
+
   if (syntax) {
     usage();
     return 1;
   }
-  
-  vector<SignedFormula *> v;
 
-  bool read_ok;
-  if (cnf)
-    read_ok = readCNF(file, v);
-  else 
-    read_ok = readProve(file, v);
-
-  Tableau *tab;
-  
-  if (method == "analytic") {
-    tab = new AnalyticTableau("1", v);
-    ((AnalyticTableau *) tab)->setStrategy(new AnalyticStrategy());
-  }
-  else if (method == "analytic+BU") {
-    tab = new AnalyticTableau("1", v);
-    ((AnalyticTableau *) tab)->setStrategy(new AnalyticBottomUpStrategy());
-  }
-  else if (method == "ke") {
-    tab = new KETableau("1", v);
-    ((KETableau *) tab)->setStrategy(new KEStrategy());
-  }
-  else if (method == "ke+V") {
-    tab = new KETableau("1", v); 
-    ((KETableau *) tab)->setStrategy(new KEValuationStrategy());
-  }
-  else if (method == "ke+P") {
-    tab = new KETableau("1", v); 
-    ((KETableau *) tab)->setStrategy(new KEPolarityStrategy());
-  }
-  else if (method == "kes3") {
-    tab = new KES3Tableau("1", v); 
-    ((KES3Tableau *) tab)->setStrategy(new KES3Strategy());
-  }
-  else if (method == "kes3+PB") {
-    tab = new KES3Tableau("1", v); 
-    ((KES3Tableau *) tab)->setStrategy(new KES3AENOTLastStrategy());
-  }
-  else { // default
-    tab = new KETableau("1", v); 
-    ((KETableau *) tab)->setStrategy(new KEPolarityStrategy());
-  }
-  
-  if (verbose) {
+  for (unsigned int i = 0; i < lists.size(); i++)
+    if (! readList(lists[i], files)) {
+      cerr << "prove: cannot read " << lists[i] << endl;
+      return 1;
+    }
+  if (methods.empty())
+    methods.push_back("analytic");
+  if (opts.format == Options::CSV) {
+    Proof::writeCSVHeader(cout);
     cout << endl;
-    cout << tab->toString() << endl;
-    cout << "-------------------------------" << endl << endl;
-  }
-
-  struct timeval startt, endt;
-
-  gettimeofday(&startt, NULL);
-
-  bool closed = tab->close();
-
-  gettimeofday(&endt, NULL);
-
-  if (endt.tv_usec < startt.tv_usec) {
-    endt.tv_sec--;
-    endt.tv_usec += 1000000;
   }
 
-  char elapsed[20];
-  sprintf(elapsed, "%ld.%06ld",
-	  endt.tv_sec - startt.tv_sec, endt.tv_usec - startt.tv_usec);
-
-  if (verbose) {
-    if (closed)
-      cout << tab->toString() << "x" << endl;
-    else
-      cout << tab->toString() << endl;
-    
-    cout << endl
-	 << "Total number of nodes:    " << tab->countNodes() << endl
-	 << "Total number of formulae: " << tab->countFormulae() << endl
-	 << "Elapsed time (s):         " << elapsed << endl;
-  }
-  else {
-    cout //<< (closed ? 1 : 0) << "\t"
-	 << tab->countNodes() << " & "
-	 << tab->countFormulae() << " & "
-	 << elapsed << " & ";
-    if (method.substr(0, 4) == "kes3")
-      cout << ((KES3Tableau *) tab)->S().size() << " & ";//endl;
-    else
-      cout << " & ";//endl;
+  if (lists.empty() && files.size() == 1 && methods.size() == 1) {
+    ostringstream err;
+    if (! prove(files[0], methods[0], opts, cout, err)) {
+      cerr << "prove: " << err.str() << endl;
+      return 1;
+    }
+    if (opts.format != Options::ROW)
+      cout << endl;
+    return 0;
   }
 
-  delete tab;
-
+  Batch batch(files, methods, opts);
+  batch.run(opts.jobs);
   return 0;
 }
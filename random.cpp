@@ -0,0 +1,130 @@
+// random: generates random problems, some valid and some not, to check
+// that the methods and the options of prove agree on their results.
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <vector>
+
+#include <iostream>
+#include <cstdlib>
+
+using namespace std;
+
+#include "formula.h"
+
+//
+// Usage: random -from n0 -to n [-atoms k] [-size s] [-seed x]
+//
+// Generates the problems random_n0, random_(n0+1), ..., random_n:
+// each one has from 1 to 3 signed formulas with about s connectives
+// (8 by default) on k atoms (4 by default). The problem n is the same
+// for the same seed (0 by default).
+//
+
+void usage()
+{
+  cout << "Usage: random -from n0 -to n [-atoms k] [-size s] [-seed x]" << endl;
+  return;
+}
+
+// A linear congruential generator, so the problems do not depend on
+// the C library.
+static unsigned long long s_state;
+
+static unsigned int pick(unsigned int n)
+{
+  s_state = s_state * 6364136223846793005ULL + 1442695040888963407ULL;
+  return (unsigned int) (s_state >> 33) % n;
+}
+
+// Returns a random formula with about size connectives on the atoms.
+static Formula *randomFormula(int size, const vector<Formula *>& atoms)
+{
+  if (size <= 0)
+    return atoms[pick(atoms.size())];
+
+  switch (pick(6)) {
+  case 0:
+    return new Formula(Formula::NOT, randomFormula(size - 1, atoms));
+  case 1: case 2: case 3:
+    {
+      static const Formula::opType ops[] =
+	{Formula::AND, Formula::OR, Formula::IMPLIES};
+      int left = pick(size);
+      return new Formula(ops[pick(3)], randomFormula(left, atoms),
+			 randomFormula(size - 1 - left, atoms));
+    }
+  default:
+    {
+      vector<Formula *> fmls;
+      int left = size - 1;
+      for (int i = 0; i < 3; i++) {
+	int part = (i == 2) ? left : pick(left + 1);
+	fmls.push_back(randomFormula(part, atoms));
+	left -= part;
+      }
+      return new Formula(pick(2) ? Formula::ANDN : Formula::ORN, fmls);
+    }
+  }
+}
+
+int main(int argc, char **argv)
+{
+  int arg, n0 = -1, nn = -1, k = 4, size = 8;
+  unsigned long seed = 0;
+  bool syntax = false;
+
+  for (arg = 1; ! syntax && arg < argc; arg++) {
+    if (arg+1 == argc)
+      syntax = true;
+    else if (strcmp(argv[arg], "-from") == 0)
+      n0 = atoi(argv[++arg]);
+    else if (strcmp(argv[arg], "-to") == 0)
+      nn = atoi(argv[++arg]);
+    else if (strcmp(argv[arg], "-atoms") == 0)
+      k = atoi(argv[++arg]);
+    else if (strcmp(argv[arg], "-size") == 0)
+      size = atoi(argv[++arg]);
+    else if (strcmp(argv[arg], "-seed") == 0)
+      seed = strtoul(argv[++arg], NULL, 10);
+    else
+      syntax = true;
+  }
+
+  if (n0 < 1 || nn < 1 || n0 > nn) {
+    cout << "Error: n0 and n must be greater than zero and n0 < n" << endl;
+    syntax = true;
+  }
+  if (k < 1 || size < 0)
+    syntax = true;
+
+  if (syntax) {
+    usage();
+    return 1;
+  }
+
+  vector<Formula *> atoms;
+  for (int i = 0; i < k; i++) {
+    char atom[12];
+    sprintf(atom, "p%d", i);
+    atoms.push_back(new Formula(string(atom)));
+  }
+
+  for (int n = n0; n <= nn; n++) {
+    s_state = seed * 1000003ULL + n;
+
+    char filename[30];
+    sprintf(filename, "random%d.prove", n);
+    ofstream f(filename);
+
+    int fmls = 1 + pick(3);
+    for (int i = 0; i < fmls; i++)
+      f << (pick(2) ? "T" : "F")
+	<< randomFormula(size / fmls, atoms)->toString() << endl;
+
+    f.close();
+  }
+
+  return 0;
+}
@@ -0,0 +1,232 @@
+/*****************************************************************************
+ * reader.cpp
+ *
+ * Definitions for the readers of the problem files.
+ *****************************************************************************/
+
+#include <cstdio>
+#include <cstdlib>
+#include <unordered_map>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "reader.h"
+
+
+//////////////////////////////////////////////////////////////////////////////
+// Members of class MappedFile.
+//////////////////////////////////////////////////////////////////////////////
+
+MappedFile::MappedFile(const string& file)
+{
+  _data = "";
+  _size = 0;
+  _ok = false;
+
+  int fd = open(file.c_str(), O_RDONLY);
+  if (fd == -1)
+    return;
+
+  struct stat st;
+  if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)) {
+    if (st.st_size == 0)
+      _ok = true;
+    else {
+      void *p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (p != MAP_FAILED) {
+	madvise(p, st.st_size, MADV_SEQUENTIAL);
+	_data = (const char *) p;
+	_size = st.st_size;
+	_ok = true;
+      }
+    }
+  }
+  close(fd);
+}
+
+MappedFile::~MappedFile()
+{
+  if (_size > 0)
+    munmap((void *) _data, _size);
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+// The readers.
+//////////////////////////////////////////////////////////////////////////////
+
+static inline bool blank(char c)
+{
+  return c == ' ' || c == '\t' || c == '\n' || c == '\r' ||
+    c == '\f' || c == '\v';
+}
+
+static inline bool digit(char c) { return c >= '0' && c <= '9'; }
+
+// Reads the integer at p, which must start with a sign or a digit.
+// Returns false if there is no digit or the integer does not fit.
+static bool readInt(const char *&p, const char *end, long& n)
+{
+  bool negative = false;
+  if (*p == '-' || *p == '+')
+    negative = *p++ == '-';
+  if (p == end || ! digit(*p))
+    return false;
+
+  n = 0;
+  while (p < end && digit(*p)) {
+    n = 10 * n + (*p++ - '0');
+    if (n > 0x7fffffffL)
+      return false;
+  }
+  if (negative)
+    n = -n;
+  return p == end || blank(*p);
+}
+
+// Undoes the reading of a file after an error: deletes the formulas
+// appended to v from size on, and the canonical formulas built after
+// the mark of the factory.
+static ParseStatus fail(ParseStatus status, vector<SignedFormula *>& v,
+			unsigned int size, unsigned int mark)
+{
+  for (unsigned int i = size; i < v.size(); i++)
+    delete v[i];
+  v.resize(size);
+  formulaFactory().rollback(mark);
+  return status;
+}
+
+ParseStatus readProve(const string& file, vector<SignedFormula *>& v)
+{
+  MappedFile in(file);
+  if (! in.ok())
+    return ParseStatus(ParseStatus::NO_FILE);
+
+  unsigned int size = v.size(), mark = formulaFactory().mark();
+  const char *p = in.begin(), *end = in.end();
+  while (true) {
+    while (p < end && blank(*p))
+      p++;
+    if (p == end)
+      return ParseStatus();
+
+    // The sign may be followed by blanks
+    char sign = *p;
+    if (sign != 'T' && sign != 'F')
+      return fail(ParseStatus(ParseStatus::BAD_SIGN, p - in.begin()),
+		  v, size, mark);
+    p++;
+    while (p < end && blank(*p))
+      p++;
+
+    const char *fml = p;
+    while (p < end && ! blank(*p))
+      p++;
+
+    Formula *p_fml;
+    ParseStatus status = parse(fml, p - fml, p_fml);
+    if (! status.ok()) {
+      status.offset += fml - in.begin();
+      return fail(status, v, size, mark);
+    }
+    v.push_back(new SignedFormula(
+		  sign == 'T' ? SignedFormula::S_T : SignedFormula::S_F,
+		  p_fml));
+  }
+}
+
+ParseStatus readCNF(const string& file, vector<SignedFormula *>& v)
+{
+  MappedFile in(file);
+  if (! in.ok())
+    return ParseStatus(ParseStatus::NO_FILE);
+
+  FormulaFactory& factory = formulaFactory();
+  unsigned int size = v.size(), mark = factory.mark();
+
+  // The literals, built on first use. They are kept by number, so the
+  // memory taken does not depend on the numbers of the variables.
+  unordered_map<long, Formula *> literals;
+  vector<Formula *> clause;
+  long vars = -1, clauses = -1, cl = 0;
+
+  const char *p = in.begin(), *end = in.end();
+  while (cl != clauses) {
+    while (p < end && blank(*p))
+      p++;
+    if (p == end || *p == '%') // some benchmarks end with a % line
+      break;
+
+    if (*p == 'c') { // comment line
+      while (p < end && *p != '\n')
+	p++;
+      continue;
+    }
+
+    if (*p == 'p') { // problem line: p cnf vars clauses
+      const char *line = p;
+      while (p < end && *p != '\n')
+	p++;
+      if (sscanf(string(line, p - line).c_str(), "p cnf %ld %ld",
+		 &vars, &clauses) != 2 || vars < 0 || clauses < 0)
+	return fail(ParseStatus(ParseStatus::BAD_PROBLEM_LINE,
+				line - in.begin()), v, size, mark);
+      continue;
+    }
+
+    long n;
+    const char *literal = p;
+    if (! readInt(p, end, n))
+      return fail(ParseStatus(ParseStatus::BAD_LITERAL,
+			      literal - in.begin()), v, size, mark);
+
+    if (n == 0) {
+      if (clause.empty())
+	return fail(ParseStatus(ParseStatus::EMPTY_CLAUSE,
+				literal - in.begin()), v, size, mark);
+      Formula *fml;
+      if (clause.size() == 1)
+	fml = clause[0];
+      else if (clause.size() == 2)
+	fml = factory.make(Formula::OR, clause[0], clause[1]);
+      else
+	fml = factory.make(Formula::ORN, clause);
+      v.push_back(new SignedFormula(SignedFormula::S_T, fml));
+      clause.clear();
+      cl++;
+      continue;
+    }
+
+    // The variables are numbered from 1 to the number of the problem
+    // line
+    long var = labs(n);
+    if (vars >= 0 && var > vars)
+      return fail(ParseStatus(ParseStatus::BAD_LITERAL,
+			      literal - in.begin()), v, size, mark);
+
+    Formula *&positive = literals[var];
+    if (positive == NULL) {
+      char name[16];
+      int len = snprintf(name, sizeof(name), "x%ld", var);
+      positive = factory.atom(name, len);
+    }
+    if (n > 0)
+      clause.push_back(positive);
+    else {
+      Formula *&negative = literals[n];
+      if (negative == NULL)
+	negative = factory.make(Formula::NOT, positive);
+      clause.push_back(negative);
+    }
+  }
+
+  // A clause without its 0 is malformed
+  if (! clause.empty())
+    return fail(ParseStatus(ParseStatus::UNTERMINATED_CLAUSE,
+			    p - in.begin()), v, size, mark);
+  return ParseStatus();
+}
@@ -0,0 +1,67 @@
+/*****************************************************************************
+ * reader.h
+ *
+ * Declarations for the readers of the problem files.
+ *****************************************************************************/
+
+#ifndef __READER_H__
+#define __READER_H__
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "tableau.h"
+
+using namespace std;
+
+
+//////////////////////////////////////////////////////////////////////////////
+// Encapsulates a file mapped read-only in memory. The readers scan the
+// mapped bytes in place, so the size of a file is limited only by the
+// address space, and the kernel reads it ahead as they go.
+//////////////////////////////////////////////////////////////////////////////
+
+class MappedFile
+{
+ public:
+  // Maps the file. ok() tells if it was possible.
+  MappedFile(const string& file);
+  ~MappedFile();
+
+  // Returns true if the file is mapped (an empty file always is).
+  bool ok() const { return _ok; }
+
+  // The bytes of the file.
+  const char *begin() const { return _data; }
+  const char *end() const { return _data + _size; }
+  size_t size() const { return _size; }
+
+ private:
+  MappedFile(const MappedFile&);
+  MappedFile& operator=(const MappedFile&);
+
+  const char *_data;
+  size_t _size;
+  bool _ok;
+};
+
+
+// The readers return the first error found in the file, with its
+// offset in bytes from the start of the file. On error, v and the
+// formula factory are left as they were before the call.
+
+// Reads a file of signed formulas: each one is a sign (T or F)
+// followed by a formula with no blanks (see parse()). Appends the
+// formulas to v.
+ParseStatus readProve(const string& file, vector<SignedFormula *>& v);
+
+// Reads a file in the DIMACS CNF format. Appends a signed formula T C
+// to v for each clause C: the atom xN stands for the variable N, and
+// clauses of more than two literals are ORN formulas. Clauses may span
+// several lines, and lines may be of any length. Reading stops after
+// the number of clauses of the problem line, if any. Empty clauses
+// and variables beyond the number of the problem line are errors.
+ParseStatus readCNF(const string& file, vector<SignedFormula *>& v);
+
+#endif
@@ -0,0 +1,137 @@
+/*****************************************************************************
+ * scheduler.cpp
+ *
+ * Definitions for the work-stealing scheduler.
+ *****************************************************************************/
+
+#include <chrono>
+
+#include <cassert>
+
+#include "scheduler.h"
+
+
+// The scheduler running the calling thread, and its worker index.
+static thread_local Scheduler *t_scheduler = NULL;
+static thread_local unsigned int t_worker = 0;
+
+
+//////////////////////////////////////////////////////////////////////////////
+// Members of class Scheduler.
+//////////////////////////////////////////////////////////////////////////////
+
+Scheduler::Scheduler(unsigned int n) : _stop(false), _idle(0)
+{
+  if (n == 0)
+    n = 1;
+  for (unsigned int w = 0; w < n; w++)
+    _workers.push_back(new Worker());
+}
+
+Scheduler::~Scheduler()
+{
+  for (unsigned int w = 0; w < _workers.size(); w++)
+    delete _workers[w];
+}
+
+Scheduler *Scheduler::current() { return t_scheduler; }
+
+void Scheduler::run(Task *task)
+{
+  assert(t_scheduler == NULL);
+
+  _stop = false;
+  for (unsigned int w = 1; w < _workers.size(); w++)
+    _threads.push_back(thread(&Scheduler::loop, this, w));
+
+  t_scheduler = this;
+  t_worker = 0;
+  execute(task);
+  t_scheduler = NULL;
+
+  _stop = true;
+  for (unsigned int i = 0; i < _threads.size(); i++)
+    _threads[i].join();
+  _threads.clear();
+}
+
+void Scheduler::spawn(Task *task)
+{
+  assert(t_scheduler == this);
+
+  Worker *worker = _workers[t_worker];
+  lock_guard<mutex> guard(worker->lock);
+  worker->tasks.push_back(task);
+}
+
+void Scheduler::join(Task *task)
+{
+  assert(t_scheduler == this);
+
+  while (! task->done()) {
+    // task is at the back of the deque unless it was stolen
+    Task *other = pop(t_worker);
+    if (other == NULL)
+      other = steal(t_worker);
+    if (other != NULL)
+      execute(other);
+    else
+      this_thread::yield();
+  }
+}
+
+void Scheduler::loop(unsigned int w)
+{
+  t_scheduler = this;
+  t_worker = w;
+
+  unsigned int misses = 0;
+  _idle++;
+  while (! _stop) {
+    Task *task = steal(w);
+    if (task != NULL) {
+      _idle--;
+      execute(task);
+      _idle++;
+      misses = 0;
+    }
+    else if (++misses < 64)
+      this_thread::yield();
+    else
+      this_thread::sleep_for(chrono::microseconds(50));
+  }
+  _idle--;
+
+  t_scheduler = NULL;
+}
+
+void Scheduler::execute(Task *task)
+{
+  task->run();
+  task->_done = true;
+}
+
+Task *Scheduler::pop(unsigned int w)
+{
+  Worker *worker = _workers[w];
+  lock_guard<mutex> guard(worker->lock);
+  if (worker->tasks.empty())
+    return NULL;
+  Task *task = worker->tasks.back();
+  worker->tasks.pop_back();
+  return task;
+}
+
+Task *Scheduler::steal(unsigned int w)
+{
+  for (unsigned int i = 1; i < _workers.size(); i++) {
+    Worker *victim = _workers[(w + i) % _workers.size()];
+    lock_guard<mutex> guard(victim->lock);
+    if (! victim->tasks.empty()) {
+      Task *task = victim->tasks.front();
+      victim->tasks.pop_front();
+      return task;
+    }
+  }
+  return NULL;
+}
@@ -0,0 +1,102 @@
+/*****************************************************************************
+ * scheduler.h
+ *
+ * Class declarations for the work-stealing scheduler.
+ *****************************************************************************/
+
+#ifndef __SCHEDULER_H__
+#define __SCHEDULER_H__
+
+#include <atomic>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+
+//////////////////////////////////////////////////////////////////////////////
+// Encapsulates a unit of work run by the scheduler.
+//////////////////////////////////////////////////////////////////////////////
+
+class Task
+{
+  friend class Scheduler;
+
+ public:
+  Task() : _done(false) { }
+  virtual ~Task() { }
+
+  // Does the work of the task.
+  virtual void run() = 0;
+
+  // Returns true if the task has been run.
+  bool done() const { return _done.load(); }
+
+ private:
+  atomic<bool> _done;
+};
+
+
+//////////////////////////////////////////////////////////////////////////////
+// Encapsulates a pool of worker threads. Each worker has a deque of
+// tasks: it pushes and pops its own tasks at the back, and steals the
+// tasks of the other workers from the front when it runs out of work.
+//////////////////////////////////////////////////////////////////////////////
+
+class Scheduler
+{
+ public:
+  // Creates a scheduler with n workers, including the thread that
+  // calls run().
+  Scheduler(unsigned int n);
+  ~Scheduler();
+
+  // Runs task in the calling thread, while the other workers run the
+  // tasks it spawns. Returns when task is done.
+  void run(Task *task);
+
+  // Makes task available to the other workers. Must be called by a
+  // task run by the scheduler, which must join() task before it ends.
+  void spawn(Task *task);
+
+  // Waits until task is done, running other tasks in the meantime.
+  void join(Task *task);
+
+  // Returns true if some worker is looking for a task to steal.
+  bool hungry() const { return _idle.load() > 0; }
+
+  // Returns the scheduler running the calling thread, or NULL if the
+  // thread is not a worker.
+  static Scheduler *current();
+
+ private:
+  struct Worker {
+    mutex lock;
+    deque<Task *> tasks;
+  };
+
+  // Main loop of the w'th worker, w > 0.
+  void loop(unsigned int w);
+
+  // Runs task and marks it as done.
+  void execute(Task *task);
+
+  // Takes the last task of the w'th worker (NULL if there is none).
+  Task *pop(unsigned int w);
+
+  // Takes the first task of a worker other than the w'th one (NULL
+  // if there is none).
+  Task *steal(unsigned int w);
+
+  vector<Worker *> _workers;
+  vector<thread> _threads;
+
+  atomic<bool> _stop;
+
+  // Number of workers looking for a task.
+  atomic<int> _idle;
+};
+
+#endif
@@ -0,0 +1,99 @@
+/*****************************************************************************
+ * stats.cpp
+ *
+ * Definitions for the statistics of a proof.
+ *****************************************************************************/
+
+#include <cstdio>
+
+#include "stats.h"
+
+
+//////////////////////////////////////////////////////////////////////////////
+// Members of class Stats.
+//////////////////////////////////////////////////////////////////////////////
+
+Stats::Stats(bool timing) : _timing(timing), _maxDepth(0)
+{
+  for (int p = 0; p < PHASES; p++)
+    _nanos[p] = 0;
+  for (int c = 0; c < COUNTERS; c++)
+    _counters[c] = 0;
+}
+
+void Stats::reach(unsigned int d)
+{
+  unsigned int max = _maxDepth.load();
+  while (d > max && ! _maxDepth.compare_exchange_weak(max, d))
+    ;
+}
+
+const char *Stats::name(Phase p)
+{
+  switch (p) {
+  case PARSE: return "parse";
+  case INIT: return "init";
+  case CLASSIFY: return "classify";
+  case ALPHA: return "alpha";
+  case BETA: return "beta";
+  case PB: return "pb";
+  case CHOOSE_PB: return "choose_pb";
+  default: return "";
+  }
+}
+
+const char *Stats::name(Counter c)
+{
+  switch (c) {
+  case NODES: return "nodes";
+  case FORMULAE: return "formulae";
+  case ALPHA_RULES: return "alpha_rules";
+  case BETA_RULES: return "beta_rules";
+  case PB_RULES: return "pb_rules";
+  case CLOSURES: return "closures";
+  default: return "";
+  }
+}
+
+// Writes the time of a phase in seconds.
+static void writeSeconds(ostream& out, double s)
+{
+  char buf[32];
+  snprintf(buf, sizeof(buf), "%.6f", s);
+  out << buf;
+}
+
+void Stats::writeJSON(ostream& out) const
+{
+  out << "\"phases\":{";
+  for (int p = 0; p < PHASES; p++) {
+    out << (p > 0 ? "," : "") << "\"" << name((Phase) p) << "\":";
+    writeSeconds(out, seconds((Phase) p));
+  }
+  out << "},\"counters\":{";
+  for (int c = 0; c < COUNTERS; c++)
+    out << (c > 0 ? "," : "") << "\"" << name((Counter) c) << "\":"
+	<< get((Counter) c);
+  out << "},\"max_depth\":" << maxDepth();
+}
+
+void Stats::writeCSVHeader(ostream& out)
+{
+  for (int p = 0; p < PHASES; p++)
+    out << (p > 0 ? "," : "") << name((Phase) p);
+  for (int c = 0; c < COUNTERS; c++)
+    out << "," << name((Counter) c);
+  out << ",max_depth";
+}
+
+void Stats::writeCSV(ostream& out) const
+{
+  for (int p = 0; p < PHASES; p++) {
+    if (p > 0)
+      out << ",";
+    writeSeconds(out, seconds((Phase) p));
+  }
+  for (int c = 0; c < COUNTERS; c++)
+    out << "," << get((Counter) c);
+  out << "," << maxDepth();
+}
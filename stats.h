@@ -0,0 +1,121 @@
+/*****************************************************************************
+ * stats.h
+ *
+ * Class declarations for the statistics of a proof.
+ *****************************************************************************/
+
+#ifndef __STATS_H__
+#define __STATS_H__
+
+#include <atomic>
+#include <chrono>
+#include <ostream>
+
+using namespace std;
+
+
+//////////////////////////////////////////////////////////////////////////////
+// Encapsulates the statistics of a proof: the time spent in each phase
+// and the counters of the work done, kept as the proof goes. It may be
+// shared by the threads closing a tableau: then the times of each
+// phase add up, and may exceed the elapsed time. The phases are timed
+// only if timing is on, as reading the clock costs more than the
+// counters.
+//////////////////////////////////////////////////////////////////////////////
+
+class Stats
+{
+ public:
+  // The phases of a proof: reading the problem, initializing the
+  // strategy of a node, classifying the formulas, applying the alpha,
+  // the beta and the PB rules and choosing the formula of a PB rule.
+  // The PB rule creates a child, so its time includes the INIT time
+  // of the child.
+  enum Phase {PARSE, INIT, CLASSIFY, ALPHA, BETA, PB, CHOOSE_PB, PHASES};
+
+  // The counters: nodes expanded, formulae of those nodes, rules
+  // applied, nodes closed by their own formulas (not by their
+  // children).
+  enum Counter {NODES, FORMULAE, ALPHA_RULES, BETA_RULES, PB_RULES,
+		CLOSURES, COUNTERS};
+
+  Stats(bool timing = false);
+
+  bool timing() const { return _timing; }
+
+  // Adds n to the counter c.
+  void count(Counter c, unsigned long n = 1)
+  { _counters[c].fetch_add(n, memory_order_relaxed); }
+
+  // Returns the counter c.
+  unsigned long get(Counter c) const { return _counters[c].load(); }
+
+  // Adds ns nanoseconds to the phase p.
+  void addTime(Phase p, unsigned long long ns)
+  { _nanos[p].fetch_add(ns, memory_order_relaxed); }
+
+  // Returns the time spent in the phase p, in seconds.
+  double seconds(Phase p) const { return _nanos[p].load() * 1e-9; }
+
+  // Records that a node of depth d was expanded.
+  void reach(unsigned int d);
+
+  // Returns the depth of the deepest node expanded (the root is 0).
+  unsigned int maxDepth() const { return _maxDepth.load(); }
+
+  // Returns the name of a phase or a counter.
+  static const char *name(Phase p);
+  static const char *name(Counter c);
+
+  // Writes the statistics as the members of a JSON object (without
+  // the braces): "phases", "counters" and "max_depth".
+  void writeJSON(ostream& out) const;
+
+  // Writes the names of the CSV fields, and the statistics as CSV
+  // fields, in the same order.
+  static void writeCSVHeader(ostream& out);
+  void writeCSV(ostream& out) const;
+
+ private:
+  Stats(const Stats&);
+  Stats& operator=(const Stats&);
+
+  bool _timing;
+  atomic<unsigned long long> _nanos[PHASES];
+  atomic<unsigned long> _counters[COUNTERS];
+  atomic<unsigned int> _maxDepth;
+};
+
+
+//////////////////////////////////////////////////////////////////////////////
+// Adds the time it is in scope to a phase of the statistics, if they
+// are not NULL and timing is on.
+//////////////////////////////////////////////////////////////////////////////
+
+class PhaseTimer
+{
+ public:
+  PhaseTimer(Stats *stats, Stats::Phase phase)
+    : _stats(stats != NULL && stats->timing() ? stats : NULL), _phase(phase)
+  {
+    if (_stats != NULL)
+      _start = chrono::steady_clock::now();
+  }
+
+  ~PhaseTimer()
+  {
+    if (_stats != NULL)
+      _stats->addTime(_phase, chrono::duration_cast<chrono::nanoseconds>(
+			chrono::steady_clock::now() - _start).count());
+  }
+
+ private:
+  PhaseTimer(const PhaseTimer&);
+  PhaseTimer& operator=(const PhaseTimer&);
+
+  Stats *_stats;
+  Stats::Phase _phase;
+  chrono::steady_clock::time_point _start;
+};
+
+#endif
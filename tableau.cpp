@@ -4,10 +4,13 @@
  * Definitions for the generic tableau.
  *****************************************************************************/
 
+#include <climits>
 #include <cstdio>
 #include <algorithm>
 #include <iterator>
+#include <queue>
 #include <string>
+#include <unordered_map>
 
 #include <cassert>
 
@@ -15,14 +18,83 @@
 #include "tableau.h"
 
 
+//////////////////////////////////////////////////////////////////////////////
+// Members of class Dependencies.
+//////////////////////////////////////////////////////////////////////////////
+
+const Dependencies *Dependencies::make(const vector<unsigned int>& v)
+{
+  if (v.empty())
+    return NULL;
+
+  Dependencies *d = (Dependencies *)
+    Arena::alloc(sizeof(Dependencies) + (v.size() - 1) * sizeof(unsigned int));
+  d->size = v.size();
+  copy(v.begin(), v.end(), d->levels);
+  return d;
+}
+
+const Dependencies *Dependencies::single(unsigned int level)
+{
+  return make(vector<unsigned int>(1, level));
+}
+
+const Dependencies *Dependencies::merge(const Dependencies *a,
+					const Dependencies *b)
+{
+  if (a == NULL || a == b)
+    return b;
+  if (b == NULL)
+    return a;
+
+  vector<unsigned int> v;
+  set_union(a->levels, a->levels + a->size, b->levels, b->levels + b->size,
+	    back_inserter(v));
+  if (v.size() == a->size)
+    return a;
+  if (v.size() == b->size)
+    return b;
+  return make(v);
+}
+
+const Dependencies *Dependencies::remove(const Dependencies *a,
+					 unsigned int level)
+{
+  if (! contains(a, level))
+    return a;
+
+  vector<unsigned int> v;
+  for (unsigned int i = 0; i < a->size; i++)
+    if (a->levels[i] != level)
+      v.push_back(a->levels[i]);
+  return make(v);
+}
+
+const Dependencies *Dependencies::range(unsigned int n)
+{
+  vector<unsigned int> v;
+  for (unsigned int l = 0; l < n; l++)
+    v.push_back(l);
+  return make(v);
+}
+
+bool Dependencies::contains(const Dependencies *a, unsigned int level)
+{
+  return a != NULL && binary_search(a->levels, a->levels + a->size, level);
+}
+
+
 //////////////////////////////////////////////////////////////////////////////
 // Members of class SignedFormula.
 //////////////////////////////////////////////////////////////////////////////
 
 SignedFormula::SignedFormula(SignedFormula::Sign s, Formula *fml)
 {
+  assert(fml->id != 0);
+
   sign = s;
   formula = fml;
+  deps = NULL;
 
   switch(fml->op) {
   case Formula::NOT:
@@ -57,7 +129,7 @@ string SignedFormula::toString() const
   return retval;
 }
 
-int SignedFormula::value(map<string, int>& valuation) const
+int SignedFormula::value(const vector<int>& valuation) const
 {
   int val = formula->value(valuation);
   if (val == -1)
@@ -70,7 +142,7 @@ int SignedFormula::value(map<string, int>& valuation) const
   }
 }
 
-int SignedFormula::polarity(const string& str) const
+int SignedFormula::polarity(unsigned int str) const
 {
   int p = formula->polarity(str);
   if (p == -1) return -1;
@@ -80,33 +152,888 @@ int SignedFormula::polarity(const string& str) const
   return -1;
 }
 
-unsigned int SignedFormula::atomsIn(const map<string, int>& valuation) const
+unsigned int SignedFormula::atomsIn(const vector<int>& valuation) const
 {
   return formula->atomsIn(valuation);
 } 
 
-unsigned int SignedFormula::atomsOut(const map<string, int>& valuation) const
+unsigned int SignedFormula::atomsOut(const vector<int>& valuation) const
 {
   return formula->atomsOut(valuation);
 } 
 
-unsigned int SignedFormula::atomsOut(const set<string>& atomset) const
+unsigned int SignedFormula::atomsOut(const vector<bool>& atomset) const
 {
   return formula->atomsOut(atomset);
 } 
 
-double SignedFormula::distanceFrom(const map<string, int>& valuation,
-				   const map<string, int>& atom_dist) const
+double SignedFormula::distanceFrom(const vector<int>& nearest) const
+{
+  return formula->distanceFrom(nearest);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Members of class AtomDistance.
+//////////////////////////////////////////////////////////////////////////////
+
+const int AtomDistance::NONE;
+const unsigned int AtomDistance::DENSE_ATOMS;
+const unsigned int AtomDistance::CACHED_ROWS;
+
+struct AtomDistance::Graph
+{
+  // The nodes of the tree, numbered from 0 to n - 1, with their
+  // neighbours and the weights of the edges, and the atoms occurring
+  // in each node. The atoms of the tree are numbered from 0 (local
+  // numbers), and local maps atom ids to them (-1 if not in the tree).
+  unsigned int n;
+  int jump;
+  vector<vector<pair<unsigned int, int> > > adj;
+  vector<vector<unsigned int> > node2atoms, occ;
+  vector<unsigned int> atoms;
+  vector<int> local;
+
+  // The rows computed, by atom id: all of them while dense, the last
+  // ones computed otherwise.
+  bool dense;
+  vector<shared_ptr<const vector<int> > > rows;
+  unordered_map<unsigned int, shared_ptr<const vector<int> > > cache;
+  mutex lock;
+
+  // Computes the row of the atom of local number src.
+  shared_ptr<const vector<int> > compute(unsigned int src) const;
+};
+
+void AtomDistance::init(const vector<int>& parent, const vector<int>& weight,
+			const map<unsigned int, set<int> >& occurrences,
+			int jump, unsigned int atoms)
+{
+  Graph *g = new Graph();
+  g->n = parent.size();
+  g->jump = jump;
+  g->adj.resize(g->n);
+  for (unsigned int v = 0; v < g->n; v++)
+    if (parent[v] != -1) {
+      g->adj[v].push_back(make_pair((unsigned int) parent[v], weight[v]));
+      g->adj[parent[v]].push_back(make_pair(v, weight[v]));
+    }
+
+  g->node2atoms.resize(g->n);
+  g->local.assign(atoms, -1);
+  for (map<unsigned int, set<int> >::const_iterator a = occurrences.begin();
+       a != occurrences.end(); a++) {
+    g->occ.push_back(vector<unsigned int>(a->second.begin(), a->second.end()));
+    for (set<int>::const_iterator it = a->second.begin();
+	 it != a->second.end(); it++)
+      g->node2atoms[*it].push_back(g->atoms.size());
+    if (a->first < atoms)
+      g->local[a->first] = g->atoms.size();
+    g->atoms.push_back(a->first);
+  }
+
+  g->dense = atoms <= DENSE_ATOMS;
+  if (g->dense)
+    g->rows.resize(atoms);
+  _g.reset(g);
+}
+
+// The distance between two atoms is the length of the shortest path
+// between an occurrence of each, where a path may also pass through
+// any other atom, moving between its occurrences at no cost. This
+// gives the distances of running Floyd-Warshall over the nodes and
+// then over the atoms. A row is a Dijkstra search from one atom. The
+// jumps are not edges of the graph, so it costs O(n log n).
+shared_ptr<const vector<int> > AtomDistance::Graph::compute(
+  unsigned int src) const
+{
+  vector<int> dist(n + atoms.size(), INT_MAX);
+  vector<bool> done(n + atoms.size()), adjacent(n);
+
+  // Nodes that have not been reached by a jump yet.
+  vector<unsigned int> nojump, keep;
+  for (unsigned int v = 0; v < n; v++)
+    nojump.push_back(v);
+
+  priority_queue<pair<int, unsigned int>,
+		 vector<pair<int, unsigned int> >,
+		 greater<pair<int, unsigned int> > > Q;
+  dist[n + src] = 0;
+  Q.push(make_pair(0, n + src));
+
+  while (! Q.empty()) {
+    int d = Q.top().first;
+    unsigned int x = Q.top().second;
+    Q.pop();
+    if (done[x])
+      continue;
+    done[x] = true;
+
+    vector<pair<unsigned int, int> > next;
+    if (x >= n) {
+      for (unsigned int k = 0; k < occ[x - n].size(); k++)
+	next.push_back(make_pair(occ[x - n][k], d));
+    }
+    else {
+      for (unsigned int k = 0; k < adj[x].size(); k++) {
+	next.push_back(make_pair(adj[x][k].first, d + adj[x][k].second));
+	adjacent[adj[x][k].first] = true;
+      }
+      for (unsigned int k = 0; k < node2atoms[x].size(); k++)
+	next.push_back(make_pair(n + node2atoms[x][k], d));
+
+      // Jumps from x. Since the nodes are visited in nondecreasing
+      // order of distance, each node only needs to be reached by a
+      // jump once; the nodes adjacent to x wait for a later jump.
+      keep.clear();
+      for (unsigned int k = 0; k < nojump.size(); k++) {
+	unsigned int v = nojump[k];
+	if (v == x || done[v])
+	  continue;
+	if (adjacent[v])
+	  keep.push_back(v);
+	else
+	  next.push_back(make_pair(v, d + jump));
+      }
+      nojump.swap(keep);
+
+      for (unsigned int k = 0; k < adj[x].size(); k++)
+	adjacent[adj[x][k].first] = false;
+    }
+
+    for (unsigned int k = 0; k < next.size(); k++)
+      if (next[k].second < dist[next[k].first]) {
+	dist[next[k].first] = next[k].second;
+	Q.push(make_pair(next[k].second, next[k].first));
+      }
+  }
+
+  vector<int> *row = new vector<int>(local.size(), NONE);
+  for (unsigned int dst = 0; dst < atoms.size(); dst++)
+    if (atoms[dst] < row->size())
+      (*row)[atoms[dst]] = dist[n + dst];
+  return shared_ptr<const vector<int> >(row);
+}
+
+shared_ptr<const vector<int> > AtomDistance::row(unsigned int a) const
+{
+  if (_g == NULL || a >= _g->local.size() || _g->local[a] == -1)
+    return shared_ptr<const vector<int> >();
+
+  Graph& g = *_g;
+  {
+    lock_guard<mutex> guard(g.lock);
+    if (g.dense && g.rows[a] != NULL)
+      return g.rows[a];
+    if (! g.dense) {
+      unordered_map<unsigned int, shared_ptr<const vector<int> > >::
+	const_iterator it = g.cache.find(a);
+      if (it != g.cache.end())
+	return it->second;
+    }
+  }
+
+  // Computed outside the lock, so the threads do not wait for each
+  // other; two of them may compute the same row.
+  shared_ptr<const vector<int> > r = g.compute(g.local[a]);
+
+  lock_guard<mutex> guard(g.lock);
+  if (g.dense)
+    g.rows[a] = r;
+  else {
+    if (g.cache.size() >= CACHED_ROWS)
+      g.cache.clear();
+    g.cache[a] = r;
+  }
+  return r;
+}
+
+int AtomDistance::get(unsigned int a, unsigned int b) const
+{
+  shared_ptr<const vector<int> > r = row(a);
+  return (r != NULL && b < r->size()) ? (*r)[b] : NONE;
+}
+
+vector<int> AtomDistance::nearest(const vector<int>& valuation) const
+{
+  unsigned int n = _g != NULL ? _g->local.size() : 0;
+  vector<int> near(n, NONE);
+  for (unsigned int v = 0; v < valuation.size() && v < n; v++) {
+    if (valuation[v] == -1)
+      continue;
+    shared_ptr<const vector<int> > r = row(v);
+    if (r == NULL)
+      continue;
+    for (unsigned int a = 0; a < n; a++)
+      if ((*r)[a] < near[a])
+	near[a] = (*r)[a];
+  }
+  return near;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Members of class BranchState.
+//////////////////////////////////////////////////////////////////////////////
+
+// Returns the random number of a key for the hash of the branch: the
+// key scrambled by the finalizer of splitmix64, so it is the same in
+// every run.
+static unsigned long long zobrist(unsigned int key)
+{
+  unsigned long long z = (key + 1) * 0x9e3779b97f4a7c15ULL;
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
+// Puts in keys the keys of the literals that eliminate the beta
+// formula fml by a KE beta rule: the components with the opposite
+// sign of a disjunction, with the same sign of a conjunction, and the
+// antecedent (true) or the consequent (false) of an implication.
+static void eliminatingKeys(const SignedFormula *fml,
+			    vector<unsigned int>& keys)
+{
+  const Formula *f = fml->formula;
+  vector<Formula *> comps;
+  vector<SignedFormula::Sign> signs;
+
+  switch (f->op) {
+  case Formula::OR: case Formula::AND:
+    comps.push_back(f->left);
+    comps.push_back(f->right);
+    signs.assign(2, (f->op == Formula::OR) ?
+		 SignedFormula::S_F : SignedFormula::S_T);
+    break;
+  case Formula::ORN: case Formula::ANDN:
+    comps = f->fmls;
+    signs.assign(comps.size(), (f->op == Formula::ORN) ?
+		 SignedFormula::S_F : SignedFormula::S_T);
+    break;
+  case Formula::IMPLIES:
+    comps.push_back(f->left);
+    signs.push_back(SignedFormula::S_T);
+    comps.push_back(f->right);
+    signs.push_back(SignedFormula::S_F);
+    break;
+  default:
+    break;
+  }
+
+  // Only atoms can be matched by the literals of a branch
+  for (unsigned int i = 0; i < comps.size(); i++)
+    if (comps[i]->op == Formula::ATOM) {
+      unsigned int key = 2 * comps[i]->id + signs[i];
+      if (find(keys.begin(), keys.end(), key) == keys.end())
+	keys.push_back(key);
+    }
+}
+
+vector<SignedFormula *> BranchState::*BranchState::member(
+  vector<SignedFormula *>& v)
+{
+  if (&v == &alphas)
+    return &BranchState::alphas;
+  else if (&v == &betas)
+    return &BranchState::betas;
+  assert(&v == &lits);
+  return &BranchState::lits;
+}
+
+void BranchState::push(vector<SignedFormula *>& v, SignedFormula *fml)
+{
+  Change c;
+  c.v = member(v);
+  c.index = v.size();
+  c.fml = NULL;
+  v.push_back(fml);
+  _trail.push_back(c);
+
+  if (fml->key() >= _pushed.size())
+    _pushed.resize(fml->key() + 1, NULL);
+  _pushed[fml->key()] = fml;
+  if (fml->key() < _nogoodWatch.size())
+    countNogoods(fml, 1);
+
+  if (c.v == &BranchState::betas)
+    pushBeta(fml);
+  else if (c.v == &BranchState::lits)
+    pushLit(fml);
+}
+
+void BranchState::erase(vector<SignedFormula *>& v, unsigned int index)
+{
+  assert(&v != &lits);
+
+  Change c;
+  c.v = member(v);
+  c.index = index;
+  c.fml = v[index];
+  v.erase(v.begin() + index);
+  _trail.push_back(c);
+
+  if (c.v == &BranchState::betas) {
+    BetaEntry& e = _betaIndex[c.fml];
+    e.active = false;
+    _applicable.erase(e.stamp);
+    countBeta(e.stamp, -1);
+  }
+}
+
+void BranchState::applyPB(SignedFormula *fml)
+{
+  Change c;
+  c.v = NULL;
+  c.index = 0;
+  c.fml = fml;
+  _trail.push_back(c);
+
+  if (fml->key() >= _appliedPB.size())
+    _appliedPB.resize(fml->key() + 1, false);
+  _appliedPB[fml->key()] = true;
+}
+
+void BranchState::undo(unsigned int m)
+{
+  while (_trail.size() > m) {
+    Change& c = _trail.back();
+    if (c.v == NULL) {
+      _appliedPB[c.fml->key()] = false;
+      _trail.pop_back();
+      continue;
+    }
+    vector<SignedFormula *>& v = this->*c.v;
+    if (c.fml == NULL) {
+      SignedFormula *fml = v.back();
+      v.pop_back();
+      _pushed[fml->key()] = NULL;
+      if (fml->key() < _nogoodWatch.size())
+	countNogoods(fml, -1);
+      if (c.v == &BranchState::betas)
+	popBeta(fml);
+      else if (c.v == &BranchState::lits)
+	popLit(fml);
+    }
+    else {
+      v.insert(v.begin() + c.index, c.fml);
+      if (c.v == &BranchState::betas) {
+	BetaEntry& e = _betaIndex[c.fml];
+	e.active = true;
+	if (e.hits > 0)
+	  _applicable[e.stamp] = c.fml;
+	countBeta(e.stamp, 1);
+      }
+    }
+    _trail.pop_back();
+  }
+}
+
+unsigned long long BranchState::hash(vector<unsigned int>& keys)
+{
+  unsigned long long h = 0;
+  _relevant.assign(_valuation.size(), false);
+  keys.clear();
+
+  for (unsigned int v = 0; v < 2; v++) {
+    const vector<SignedFormula *>& fmls = v == 0 ? alphas : betas;
+    for (unsigned int i = 0; i < fmls.size(); i++) {
+      if (fmls[i]->value(_valuation) == 1)
+	continue;
+      h ^= zobrist(fmls[i]->key());
+      keys.push_back(fmls[i]->key());
+      _atoms.clear();
+      fmls[i]->formula->atomIds(_atoms);
+      for (unsigned int j = 0; j < _atoms.size(); j++)
+	if (_atoms[j] < _relevant.size())
+	  _relevant[_atoms[j]] = true;
+    }
+  }
+
+  // Each key once, though lits may repeat it
+  for (unsigned int i = 0; i < lits.size(); i++) {
+    unsigned int k = lits[i]->key();
+    if (_firstLit[k] == i && _relevant[lits[i]->formula->atomId]) {
+      h ^= zobrist(k);
+      keys.push_back(k);
+    }
+  }
+  sort(keys.begin(), keys.end());
+  return h;
+}
+
+bool BranchState::applicableBeta(unsigned int& beta, unsigned int& lit) const
+{
+  if (_applicable.empty())
+    return false;
+
+  SignedFormula *fml = _applicable.begin()->second;
+  const BetaEntry& e = _betaIndex.find(fml)->second;
+  beta = betaPosition(e.stamp);
+
+  lit = lits.size();
+  for (unsigned int i = 0; i < e.keys.size(); i++) {
+    unsigned int k = e.keys[i];
+    if (k < _litCount.size() && _litCount[k] > 0 && _firstLit[k] < lit)
+      lit = _firstLit[k];
+  }
+
+  return true;
+}
+
+void BranchState::pushBeta(SignedFormula *fml)
+{
+  BetaEntry& e = _betaIndex[fml];
+  e.stamp = _stamp++;
+  e.keys.clear();
+  eliminatingKeys(fml, e.keys);
+  e.hits = 0;
+  e.active = true;
+
+  for (unsigned int i = 0; i < e.keys.size(); i++) {
+    unsigned int k = e.keys[i];
+    if (k >= _watch.size())
+      _watch.resize(k + 1);
+    _watch[k].push_back(fml);
+    if (k < _litCount.size() && _litCount[k] > 0)
+      e.hits++;
+  }
+
+  if (e.hits > 0)
+    _applicable[e.stamp] = fml;
+  countBeta(e.stamp, 1);
+}
+
+void BranchState::popBeta(SignedFormula *fml)
+{
+  // Betas are popped in the reverse order of their pushes, so fml is
+  // the last beta watching each of its keys.
+  BetaEntry& e = _betaIndex[fml];
+  for (unsigned int i = 0; i < e.keys.size(); i++)
+    _watch[e.keys[i]].pop_back();
+  _applicable.erase(e.stamp);
+  countBeta(e.stamp, -1);
+  _stamp = e.stamp;
+  _betaIndex.erase(fml);
+}
+
+void BranchState::countBeta(unsigned long stamp, int delta)
+{
+  // Doubling the tree only adds a node covering the whole old tree:
+  // the other new nodes cover new stamps, none counted yet
+  unsigned int n = _betaCount.empty() ? 0 : _betaCount.size() - 1;
+  while (stamp >= n) {
+    unsigned int total = betaPosition(n);
+    n = n == 0 ? 1 : 2 * n;
+    _betaCount.resize(n + 1, 0);
+    _betaCount[n] = total;
+  }
+
+  for (unsigned long i = stamp + 1; i <= n; i += i & -i)
+    _betaCount[i] += delta;
+}
+
+unsigned int BranchState::betaPosition(unsigned long stamp) const
+{
+  unsigned int position = 0;
+  for (unsigned long i = stamp; i > 0; i -= i & -i)
+    position += _betaCount[i];
+  return position;
+}
+
+void BranchState::pushLit(SignedFormula *fml)
+{
+  // Room for the keys of both signs
+  unsigned int k = fml->key();
+  if ((k | 1) >= _litCount.size()) {
+    _litCount.resize((k | 1) + 1, 0);
+    _firstLit.resize((k | 1) + 1, 0);
+  }
+
+  if (_litCount[k]++ > 0)
+    return;
+
+  _firstLit[k] = lits.size() - 1;
+  if (_litCount[k ^ 1] > 0 && _contradictions++ == 0)
+    _conflict = k;
+  unsigned int atom = fml->formula->atomId;
+  int before = atom < _valuation.size() ? _valuation[atom] : -1;
+  updateValue(fml);
+  if (_tracking)
+    trackValue(atom, before);
+
+  if (k < _watch.size())
+    for (unsigned int i = 0; i < _watch[k].size(); i++) {
+      BetaEntry& e = _betaIndex[_watch[k][i]];
+      if (e.hits++ == 0 && e.active)
+	_applicable[e.stamp] = _watch[k][i];
+    }
+}
+
+void BranchState::popLit(SignedFormula *fml)
+{
+  unsigned int k = fml->key();
+
+  if (--_litCount[k] > 0)
+    return;
+
+  if (_litCount[k ^ 1] > 0)
+    _contradictions--;
+  updateValue(fml);
+  if (_tracking)
+    untrackValue();
+
+  if (k < _watch.size())
+    for (unsigned int i = 0; i < _watch[k].size(); i++) {
+      BetaEntry& e = _betaIndex[_watch[k][i]];
+      if (--e.hits == 0 && e.active)
+	_applicable.erase(e.stamp);
+    }
+}
+
+void BranchState::updateValue(const SignedFormula *lit)
+{
+  unsigned int atom = lit->formula->atomId;
+  unsigned int k = 2 * lit->formula->id;
+  bool f = _litCount[k] > 0, t = _litCount[k + 1] > 0;
+
+  if (atom >= _valuation.size())
+    _valuation.resize(atom + 1, -1);
+  _valuation[atom] = (t && ! f) ? 1 : ((f && ! t) ? 0 : -1);
+}
+
+const vector<int>& BranchState::nearest(const AtomDistance& dist)
+{
+  if (! _tracking) {
+    _dist = dist;
+    _nearest = dist.nearest(_valuation);
+    _nearestTrail.clear();
+    _nearestEvents.clear();
+    _stale = 0;
+    _tracking = true;
+  }
+
+  // Only a closed branch has stale distances, so this is rare
+  if (_stale > 0) {
+    _staleNearest = dist.nearest(_valuation);
+    return _staleNearest;
+  }
+  return _nearest;
+}
+
+void BranchState::trackValue(unsigned int atom, int before)
+{
+  NearestEvent e;
+  e.trail = _nearestTrail.size();
+  e.left = before != -1 && _valuation[atom] == -1;
+  if (e.left)
+    _stale++;
+  else if (before == -1 && _valuation[atom] != -1) {
+    shared_ptr<const vector<int> > r = _dist.row(atom);
+    for (unsigned int a = 0; r != NULL && a < r->size() &&
+	   a < _nearest.size(); a++)
+      if ((*r)[a] < _nearest[a]) {
+	NearestChange c;
+	c.atom = a;
+	c.distance = _nearest[a];
+	_nearestTrail.push_back(c);
+	_nearest[a] = (*r)[a];
+      }
+  }
+  _nearestEvents.push_back(e);
+}
+
+void BranchState::untrackValue()
+{
+  // The literal was pushed before the distances were tracked: they
+  // will be computed again if needed
+  if (_nearestEvents.empty()) {
+    _tracking = false;
+    return;
+  }
+
+  NearestEvent e = _nearestEvents.back();
+  _nearestEvents.pop_back();
+  if (e.left)
+    _stale--;
+  while (_nearestTrail.size() > e.trail) {
+    _nearest[_nearestTrail.back().atom] = _nearestTrail.back().distance;
+    _nearestTrail.pop_back();
+  }
+}
+
+void BranchState::reserveAtoms(unsigned int n)
+{
+  if (_valuation.size() < n)
+    _valuation.resize(n, -1);
+}
+
+void BranchState::learn(const vector<SignedFormula *>& nogood)
+{
+  map<unsigned int, SignedFormula *> byKey;
+  for (unsigned int i = 0; i < nogood.size(); i++)
+    byKey[nogood[i]->key()] = nogood[i];
+
+  vector<unsigned int> keys;
+  Nogood n;
+  for (map<unsigned int, SignedFormula *>::const_iterator it = byKey.begin();
+       it != byKey.end(); it++) {
+    keys.push_back(it->first);
+    n.fmls.push_back(it->second);
+  }
+  if (keys.empty() || ! _learned.insert(keys).second)
+    return;
+
+  n.present = 0;
+  for (unsigned int i = 0; i < keys.size(); i++) {
+    if (keys[i] >= _nogoodWatch.size())
+      _nogoodWatch.resize(keys[i] + 1);
+    _nogoodWatch[keys[i]].push_back(_nogoods.size());
+    if (seen(keys[i]))
+      n.present++;
+  }
+  if (n.present + 1 >= n.fmls.size())
+    _ready.insert(_nogoods.size());
+  _nogoods.push_back(n);
+}
+
+void BranchState::countNogoods(const SignedFormula *fml, int delta)
+{
+  const vector<unsigned int>& watch = _nogoodWatch[fml->key()];
+  for (unsigned int i = 0; i < watch.size(); i++) {
+    Nogood& n = _nogoods[watch[i]];
+    n.present += delta;
+    if (n.present + 1 >= n.fmls.size())
+      _ready.insert(watch[i]);
+    else
+      _ready.erase(watch[i]);
+  }
+}
+
+bool BranchState::propagate(SignedFormula *&lemma)
+{
+  const Nogood *unit = NULL;
+  unsigned int missing = 0;
+
+  lemma = NULL;
+  for (set<unsigned int>::const_iterator it = _ready.begin();
+       it != _ready.end(); it++) {
+    const Nogood& n = _nogoods[*it];
+    if (n.present == n.fmls.size())
+      return true;
+    if (unit != NULL)
+      continue;
+
+    unsigned int i = 0;
+    while (seen(n.fmls[i]))
+      i++;
+    if (! seen(n.fmls[i]->key() ^ 1)) {
+      unit = &n;
+      missing = i;
+    }
+  }
+
+  // The opposite of the missing formula follows from the others
+  if (unit != NULL) {
+    SignedFormula *fml = unit->fmls[missing];
+    lemma = new SignedFormula(fml->sign == SignedFormula::S_T ?
+			      SignedFormula::S_F : SignedFormula::S_T,
+			      fml->formula);
+    for (unsigned int i = 0; i < unit->fmls.size(); i++)
+      if (i != missing)
+	lemma->deps = Dependencies::merge(lemma->deps,
+					  _pushed[unit->fmls[i]->key()]->deps);
+  }
+  return false;
+}
+
+const Dependencies *BranchState::conflict() const
+{
+  const Dependencies *deps = NULL;
+  if (_contradictions > 0) {
+    deps = Dependencies::merge(lits[_firstLit[_conflict]]->deps,
+			       lits[_firstLit[_conflict ^ 1]]->deps);
+    return deps;
+  }
+
+  for (set<unsigned int>::const_iterator it = _ready.begin();
+       it != _ready.end(); it++) {
+    const Nogood& n = _nogoods[*it];
+    if (n.present == n.fmls.size()) {
+      for (unsigned int i = 0; i < n.fmls.size(); i++)
+	deps = Dependencies::merge(deps, _pushed[n.fmls[i]->key()]->deps);
+      return deps;
+    }
+  }
+  return deps;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Members of class TranspositionTable.
+//////////////////////////////////////////////////////////////////////////////
+
+// Approximate memory taken by a state in the list and in the map of
+// the LRU and FIFO policies, without its keys: the nodes, their links
+// and a bucket.
+static const size_t LIST_ENTRY_BYTES =
+  2 * sizeof(unsigned long long) + sizeof(vector<unsigned int>) +
+  5 * sizeof(void *) + sizeof(size_t);
+
+TranspositionTable::TranspositionTable(size_t bytes, Policy policy)
+{
+  _policy = policy;
+  _bytes = bytes;
+  _used = 0;
+  _hits = 0;
+  if (_policy == REPLACE) {
+    _slots.resize(bytes / sizeof(Entry));
+    _used = _slots.size() * sizeof(Entry);
+  }
+}
+
+size_t TranspositionTable::entryBytes(const vector<unsigned int>& keys) const
+{
+  size_t bytes = keys.size() * sizeof(unsigned int);
+  return _policy == REPLACE ? bytes : bytes + LIST_ENTRY_BYTES;
+}
+
+bool TranspositionTable::lookup(unsigned long long hash,
+				const vector<unsigned int>& keys)
+{
+  lock_guard<mutex> guard(_mutex);
+
+  // The empty state is never closed, and marks the empty slots
+  if (keys.empty())
+    return false;
+
+  bool found = false;
+  if (_policy == REPLACE) {
+    if (! _slots.empty()) {
+      const Entry& e = _slots[hash % _slots.size()];
+      found = e.hash == hash && e.keys == keys;
+    }
+  }
+  else {
+    unordered_map<unsigned long long, list<Entry>::iterator>::iterator it =
+      _entries.find(hash);
+    found = it != _entries.end() && it->second->keys == keys;
+    if (found && _policy == LRU)
+      _order.splice(_order.end(), _order, it->second);
+  }
+
+  if (found)
+    _hits++;
+  return found;
+}
+
+void TranspositionTable::insert(unsigned long long hash,
+				const vector<unsigned int>& keys)
+{
+  lock_guard<mutex> guard(_mutex);
+
+  size_t bytes = entryBytes(keys);
+  if (keys.empty())
+    return;
+
+  if (_policy == REPLACE) {
+    if (_slots.empty())
+      return;
+    Entry& e = _slots[hash % _slots.size()];
+    size_t old = entryBytes(e.keys);
+    if (_used - old + bytes > _bytes)
+      return;
+    _used = _used - old + bytes;
+    e.hash = hash;
+    e.keys = keys;
+    return;
+  }
+
+  // A state with the same hash is replaced, as the newer one is more
+  // likely to be reached again
+  unordered_map<unsigned long long, list<Entry>::iterator>::iterator it =
+    _entries.find(hash);
+  if (it != _entries.end()) {
+    _used -= entryBytes(it->second->keys);
+    _order.erase(it->second);
+    _entries.erase(it);
+  }
+  if (bytes > _bytes)
+    return;
+  while (_used + bytes > _bytes) {
+    _used -= entryBytes(_order.front().keys);
+    _entries.erase(_order.front().hash);
+    _order.pop_front();
+  }
+
+  Entry e;
+  e.hash = hash;
+  e.keys = keys;
+  _entries[hash] = _order.insert(_order.end(), e);
+  _used += bytes;
+}
+
+unsigned long TranspositionTable::hits() const
+{
+  lock_guard<mutex> guard(_mutex);
+  return _hits;
+}
+
+
+//////////////////////////////////////////////////////////////////////////////
+// Members of class Budget.
+//////////////////////////////////////////////////////////////////////////////
+
+Budget::Budget(unsigned long nodes, unsigned long formulae,
+	       size_t bytes, double seconds, const Arena *arena)
+  : _maxNodes(nodes), _maxFormulae(formulae), _maxBytes(bytes),
+    _maxSeconds(seconds), _arena(arena ? arena : Arena::current()),
+    _start(chrono::steady_clock::now()),
+    _nodes(0), _formulae(0), _exceeded(NONE)
 {
-  return formula->distanceFrom(valuation, atom_dist);
 }
 
+bool Budget::spend(unsigned long formulae)
+{
+  unsigned long n = ++_nodes;
+  unsigned long f = (_formulae += formulae);
+
+  if (_maxNodes != 0 && n > _maxNodes)
+    exceed(NODES);
+  if (_maxFormulae != 0 && f > _maxFormulae)
+    exceed(FORMULAE);
+  if (n % CHECK_PERIOD == 0) {
+    if (_maxBytes != 0 && _arena != NULL && _arena->bytes() > _maxBytes)
+      exceed(BYTES);
+    if (_maxSeconds != 0 &&
+	chrono::duration<double>(chrono::steady_clock::now() -
+				 _start).count() > _maxSeconds)
+      exceed(TIME);
+  }
+  return _exceeded.load() == NONE;
+}
+
+void Budget::exceed(Resource resource)
+{
+  int none = NONE;
+  _exceeded.compare_exchange_strong(none, resource);
+}
+
+const char *Budget::name(Resource resource)
+{
+  switch (resource) {
+  case NODES: return "nodes";
+  case FORMULAE: return "formulae";
+  case BYTES: return "bytes";
+  case TIME: return "time";
+  default: return "none";
+  }
+}
+
+
 //////////////////////////////////////////////////////////////////////////////
 // Members of class TableauStrategy.
 //////////////////////////////////////////////////////////////////////////////
 TableauStrategy::TableauStrategy()
 {
   _items = _alphas = _betas = _lits = NULL;
+  _branch = NULL;
   _fw_done = false;
 }
 
@@ -115,43 +1042,22 @@ TableauStrategy::~TableauStrategy() { }
 
 bool TableauStrategy::init(const string& tableau_id,
 			   vector<SignedFormula *> *items,
-			   vector<SignedFormula *> *alphas,
-			   vector<SignedFormula *> *betas,
-			   vector<SignedFormula *> *lits)
+			   BranchState *branch)
 {
   unsigned int i;
 
   bool closed = false;
   id = tableau_id;
   _items = items;
-  _alphas = alphas;
-  _betas = betas;
-  _lits = lits;
-
-  _mlits.clear();
-
-  for (i = 0; i < _lits->size(); i++) {
-    if ((*_lits)[i]->type() == SignedFormula::LITERAL) {
-      string atom = (*_lits)[i]->formula->atom;
-      SignedFormula::Sign sign = (*_lits)[i]->sign;
-      if (sign == SignedFormula::S_T) {
-	if (_mlits.find(atom) == _mlits.end())
-	  _mlits[atom] = 2;
-	else
-	  _mlits[atom] = _mlits[atom] | 2;
-      }
-      else {
-	if (_mlits.find(atom) == _mlits.end())
-	  _mlits[atom] = 1;
-	else
-	  _mlits[atom] = _mlits[atom] | 1;
-      }
-      if (_mlits[atom] == 3)
-	closed = true;
-    }
-  }
+  _branch = branch;
+  _alphas = &branch->alphas;
+  _betas = &branch->betas;
+  _lits = &branch->lits;
+
+  _branch->reserveAtoms(formulaFactory().atomCount());
+  closed = _branch->contradictory();
 
-  // *** Floyd-Warshall all pair shortest path algorithm ***
+  // *** Distances between atoms ***
 
   if (! _fw_done) {    
     vector<Formula *> vt, vf;
@@ -186,189 +1092,79 @@ bool TableauStrategy::init(const string& tableau_id,
     //    cout << fml->toString() << endl;
     
     unsigned int sz_op = fml->size(false);
-    
-    unsigned int j;
-    
-    // Matrix of nodes.
-    int **M;
-    
-    M = (int **) malloc(sz_op * sizeof(int *));
-    for (i = 0; i < sz_op; i++) {
-      M[i] = (int *) malloc(sz_op * sizeof(int));
-      for (j = 0; j < sz_op; j++)
-	M[i][j] = 2 * sz_op;
-      M[i][i] = 0;
-    }
 
     _max_atom_dist = 2 * sz_op;
 
-    
+    // The connective nodes of fml form a tree. An edge between a node
+    // and its parent weighs 1, except for the nodes of level 2, whose
+    // edges weigh 1000000. Any two nodes not linked by an edge are at
+    // distance 2 * sz_op (a "jump").
+    vector<int> parent, weight;
+
     // Maps the occurrences of the atoms in the nodes.
-    map<string, set<int> > atom2node;
-    
-    int nextnode = 0;
-    init_floyd_warshall(fml, vt.size(), vf.size(),
-			M, atom2node, -1, &nextnode, 0);
+    map<unsigned int, set<int> > atom2node;
     
-    unsigned int k;
-
-    for (k = 0; k < sz_op; k++) {
-      for (i = 0; i < sz_op; i++)
-	for (j = 0; j < sz_op; j++) {
-	  int dist = M[i][k] + M[k][j];
-	  if (dist < M[i][j]) {
-	    M[i][j] = dist;
-	  }
-	}
-    }
-    
-//     // Printing...
+    init_distances(fml, parent, weight, atom2node, -1, 0);
+
+    // The distances from each atom are computed when first needed
+    // (see AtomDistance)
+    _atom_dist.init(parent, weight, atom2node, 2 * sz_op,
+		    formulaFactory().atomCount());
 
-//     for (i = 0; i < sz_op; i++) {
-//       for (j = 0; j < sz_op; j++)
-// 	cout << M[i][j] << " ";
-//       cout << endl;
-//     }
-    
-//     cout << endl;
-    
-//     for (map<string, set<int> >::const_iterator it = atom2node.begin();
-// 	 it != atom2node.end(); it++) {
-//       cout << it->first << " ";
-//       copy(it->second.begin(), it->second.end(),
-// 	   ostream_iterator<int>(cout, " "));
-//       cout << endl;
-//     }
-
-    // Calculating the distance between the atoms. The distance
-    // between a and b is the minimum distance between an occurrence
-    // of a and an occurrence of b.
-
-    _atom_dist.clear();
-
-    set<string> atomset;
-
-    map<string, set<int> >::const_iterator a, b;
-    for (a = atom2node.begin(); a != atom2node.end(); a++) {
-      atomset.insert(a->first);
-      for (b = a; b != atom2node.end(); b++) {
-	if (b == a) {
-	  string key(a->first);
-	  key.append(",");
-	  key.append(a->first);
-	  _atom_dist[key] = 0;
-	}
-	else {
-	  set<int>::const_iterator as, bs;
-	  int d = M[*a->second.begin()][*b->second.begin()];
-	  for (as = a->second.begin(); as != a->second.end(); as++)
-	    for (bs = b->second.begin(); bs != b->second.end(); bs++) {
-	      if (M[*as][*bs] < d)
-		d = M[*as][*bs];
-	    }
-	  string key1(a->first);
-	  key1.append(",");
-	  key1.append(b->first);	
-	  string key2(b->first);
-	  key2.append(",");
-	  key2.append(a->first);	
-	  _atom_dist[key1] = d;
-	  _atom_dist[key2] = d;
-	}
-      }
-    }
-    
-    set<string>::const_iterator m, n, p;
-    for (m = atomset.begin(); m != atomset.end(); m++) {
-      for (n = atomset.begin(); n != atomset.end(); n++) {
-	for (p = atomset.begin(); p != atomset.end(); p++) {
-	  string np(*n + "," + *p), nm(*n + "," + *m), mp(*m + "," + *p); 
-	  assert(_atom_dist.find(np) != _atom_dist.end());
-	  assert(_atom_dist.find(nm) != _atom_dist.end());
-	  assert(_atom_dist.find(mp) != _atom_dist.end());
-	  if (_atom_dist[nm] + _atom_dist[mp] < _atom_dist[np])
-	    _atom_dist[np] = _atom_dist[nm] + _atom_dist[mp];
-	}
-      }
-    }
-    
-//     map<string, int>::const_iterator dit;
-//     for (dit = _atom_dist.begin(); dit != _atom_dist.end(); dit++)
-//       cout << dit->first << " " << dit->second << endl;
-    
-    // Freeing resources...
-    
-    for (i = 0; i < sz_op; i++)
-      free(M[i]);
-    free(M);
-    
     _fw_done = true;
   }
 
   return closed;
 }
 
-void TableauStrategy::init_floyd_warshall(Formula *fml, int nt, int nf,
-					  int **M,
-					  map<string, set<int> >& atom2node,
-					  int parent,
-					  int *nextnode, int level)
+void TableauStrategy::init_distances(Formula *fml,
+				     vector<int>& parent, vector<int>& weight,
+				     map<unsigned int, set<int> >& atom2node,
+				     int parentnode, int level)
 {
-  switch (fml->op) {
-  case Formula::ATOM:
-    {
-      if (parent != -1)
-	atom2node[fml->atom].insert(parent);
-    }
-    break;
-  case Formula::NOT:
-    {
-      if (parent != -1) {
-	if (level == 2)
-	  M[parent][*nextnode] = M[*nextnode][parent] = 1000000;
-	else
-	  M[parent][*nextnode] = M[*nextnode][parent] = 1;
-      }
-      int thisnode = *nextnode;
-      *nextnode = *nextnode + 1;
-      init_floyd_warshall(fml->right, nt, nf,
-			  M, atom2node, thisnode, nextnode, level+1);
+  // Nodes are numbered in preorder. Each entry holds a formula, the
+  // node of its parent and its level.
+  struct Entry { Formula *fml; int parentnode, level; };
+  vector<Entry> pending;
+  Entry e = { fml, parentnode, level };
+  pending.push_back(e);
+
+  while (! pending.empty()) {
+    e = pending.back();
+    pending.pop_back();
+
+    if (e.fml->op == Formula::ATOM) {
+      if (e.parentnode != -1)
+	atom2node[e.fml->atomId].insert(e.parentnode);
+      continue;
     }
-    break;
-  case Formula::AND: case Formula::OR: case Formula::IMPLIES:
-    {
-      if (parent != -1) {
-	if (level == 2)
-	  M[parent][*nextnode] = M[*nextnode][parent] = 1000000;
-	else
-	  M[parent][*nextnode] = M[*nextnode][parent] = 1;
-      }
-      int thisnode = *nextnode;
-      *nextnode = *nextnode + 1;
-      init_floyd_warshall(fml->left, nt, nf,
-			  M, atom2node, thisnode, nextnode, level+1);
-      init_floyd_warshall(fml->right, nt, nf,
-			  M, atom2node, thisnode, nextnode, level+1);
+
+    int thisnode = parent.size();
+    parent.push_back(e.parentnode);
+    weight.push_back(e.level == 2 ? 1000000 : 1);
+
+    // The subformulas are pushed right to left, to be numbered left
+    // to right
+    vector<Formula *> subs;
+    switch (e.fml->op) {
+    case Formula::NOT:
+      subs.push_back(e.fml->right);
+      break;
+    case Formula::AND: case Formula::OR: case Formula::IMPLIES:
+      subs.push_back(e.fml->left);
+      subs.push_back(e.fml->right);
+      break;
+    case Formula::ANDN: case Formula::ORN:
+      subs = e.fml->fmls;
+      break;
+    default:
+      break;
     }
-    break;
-  case Formula::ANDN: case Formula::ORN:
-    {
-      if (parent != -1) {
-	if (level == 2)
-	  M[parent][*nextnode] = M[*nextnode][parent] = 1000000;
-	else
-	  M[parent][*nextnode] = M[*nextnode][parent] = 1;
-      }
-      int thisnode = *nextnode;
-      *nextnode = *nextnode + 1;
-      for (unsigned int j = 0; j < fml->fmls.size(); j++)
-	init_floyd_warshall(fml->fmls[j], nt, nf,
-			    M, atom2node, thisnode, nextnode, level+1);
+    for (unsigned int j = subs.size(); j > 0; j--) {
+      Entry sub = { subs[j-1], thisnode, e.level + 1 };
+      pending.push_back(sub);
     }
-    break;
   }
-
-  return;
 }
 
 bool TableauStrategy::classify(unsigned int& index)
@@ -382,33 +1178,17 @@ bool TableauStrategy::classify(unsigned int& index)
     SignedFormula::fmlType ty = (*_items)[i]->type();
     switch (ty) {
     case SignedFormula::ALPHA:
-      if (find(_alphas->begin(), _alphas->end(), (*_items)[i]) ==
-	  _alphas->end())
-	_alphas->push_back((*_items)[i]);
+      if (! _branch->seen((*_items)[i]))
+	_branch->push(*_alphas, (*_items)[i]);
       break;
     case SignedFormula::BETA:
-      if (find(_betas->begin(), _betas->end(), (*_items)[i]) == _betas->end())
-	_betas->push_back((*_items)[i]);
+      if (! _branch->seen((*_items)[i]))
+	_branch->push(*_betas, (*_items)[i]);
       break;
     case SignedFormula::LITERAL:
-      if (find(_lits->begin(), _lits->end(), (*_items)[i]) == _lits->end()) {
-	_lits->push_back((*_items)[i]);
-
-	string atom = (*_items)[i]->formula->atom;
-	SignedFormula::Sign sign = (*_items)[i]->sign;
-	if (sign == SignedFormula::S_T) {
-	  if (_mlits.find(atom) == _mlits.end())
-	    _mlits[atom] = 2;
-	  else
-	    _mlits[atom] = _mlits[atom] | 2;
-	}
-	else {
-	  if (_mlits.find(atom) == _mlits.end())
-	    _mlits[atom] = 1;
-	  else
-	    _mlits[atom] = _mlits[atom] | 1;
-	}
-	if (_mlits[atom] == 3)
+      if (! _branch->seen((*_items)[i])) {
+	_branch->push(*_lits, (*_items)[i]);
+	if (_branch->contradictory())
 	  closed = true;
       }
       break;
@@ -430,22 +1210,45 @@ unsigned int TableauStrategy::chooseBeta() { return 0; }
 //////////////////////////////////////////////////////////////////////////////
 
 Tableau::Tableau(const string& id, SignedFormula *fml,
-		 Tableau *parent)
+		 Tableau *parent, BranchState *branch)
 {
   _items.push_back(fml);
   _parent = parent;
   _id = id;
+  _branch = branch ? branch : parent ? parent->_branch : new BranchState();
+  _ownsBranch = (branch != NULL || parent == NULL);
+  _cancel = parent ? parent->_cancel : NULL;
+  _budget = parent ? parent->_budget : NULL;
+  _cancelled = false;
+  _stats = parent ? parent->_stats : NULL;
+  _depth = parent ? parent->_depth + 1 : 0;
 }
 
 Tableau::Tableau(const string& id, const vector<SignedFormula *>& fmls,
-		 Tableau *parent)
+		 Tableau *parent, BranchState *branch)
 {
   _items = fmls;
   _parent = parent;
   _id = id;
+  _branch = branch ? branch : parent ? parent->_branch : new BranchState();
+  _ownsBranch = (branch != NULL || parent == NULL);
+  _cancel = parent ? parent->_cancel : NULL;
+  _budget = parent ? parent->_budget : NULL;
+  _cancelled = false;
+  _stats = parent ? parent->_stats : NULL;
+  _depth = parent ? parent->_depth + 1 : 0;
 }
 
-Tableau::~Tableau() { }
+Tableau::~Tableau()
+{
+  if (_ownsBranch)
+    delete _branch;
+}
+
+void Tableau::finalize(void *p)
+{
+  ((Tableau *) p)->~Tableau();
+}
 
 void Tableau::setStrategy(TableauStrategy *strategy)
 {
@@ -453,6 +1256,22 @@ void Tableau::setStrategy(TableauStrategy *strategy)
 }
 
 string Tableau::toString(int level) const
+{
+  string s;
+  vector<pair<const Tableau *, int> > pending(1, make_pair(this, level));
+  while (! pending.empty()) {
+    const Tableau *tab = pending.back().first;
+    int lv = pending.back().second;
+    pending.pop_back();
+    s += tab->nodeToString(lv);
+    for (unsigned int i = tab->_children.size(); i > 0; i--)
+      if (tab->_children[i-1] != NULL)
+	pending.push_back(make_pair(tab->_children[i-1], lv + 2));
+  }
+  return s;
+}
+
+string Tableau::nodeToString(int level) const
 {
   string s;
   unsigned int i;
@@ -463,28 +1282,79 @@ string Tableau::toString(int level) const
     s += string(level, ' ') + si + " " + _items[i]->toString() + "\n";
   }
 
-  for (i = 0; i < _children.size(); i++)
-    if (_children[i] != NULL)
-      s += _children[i]->toString(level+2);
-
   return s;
 }
 
+bool Tableau::close()
+{
+  // The nodes being expanded, from this tableau down to the current
+  // node. A node is resumed when its last child is done.
+  // When cancelled or out of budget, the nodes are resumed as if the
+  // child they wait for was open, so they undo their changes and
+  // return.
+  vector<Tableau *> stack(1, this);
+  Step step = stopped() ? OPEN : expandNode();
+  for (;;) {
+    if (step == SPLIT && stopped())
+      step = stack.back()->resume(false);
+    else if (step == SPLIT) {
+      Tableau *child = stack.back()->_children.back();
+      stack.push_back(child);
+      step = child->expandNode();
+    }
+    else {
+      stack.pop_back();
+      if (stack.empty()) {
+	_cancelled = stopped();
+	return step == CLOSED && ! _cancelled;
+      }
+      step = stack.back()->resume(step == CLOSED);
+    }
+  }
+}
+
+Tableau::Step Tableau::expandNode()
+{
+  Step step = expand();
+  if (_budget != NULL)
+    _budget->spend(_items.size());
+  if (_stats != NULL) {
+    _stats->count(Stats::NODES);
+    _stats->count(Stats::FORMULAE, _items.size());
+    if (step == CLOSED)
+      _stats->count(Stats::CLOSURES);
+    _stats->reach(_depth);
+  }
+  return step;
+}
+
 unsigned int Tableau::countNodes()
 {
-  unsigned int i, total = 1;
-  for (i = 0; i < _children.size(); i++)
-    if (_children[i] != NULL)
-      total += _children[i]->countNodes();
+  unsigned int total = 0;
+  vector<Tableau *> pending(1, this);
+  while (! pending.empty()) {
+    Tableau *tab = pending.back();
+    pending.pop_back();
+    total++;
+    for (unsigned int i = 0; i < tab->_children.size(); i++)
+      if (tab->_children[i] != NULL)
+	pending.push_back(tab->_children[i]);
+  }
   return total;
 }
 
 unsigned int Tableau::countFormulae()
 {
-  unsigned int i, total = _items.size();
-  for (i = 0; i < _children.size(); i++)
-    if (_children[i] != NULL)
-      total += _children[i]->countFormulae();
+  unsigned int total = 0;
+  vector<Tableau *> pending(1, this);
+  while (! pending.empty()) {
+    Tableau *tab = pending.back();
+    pending.pop_back();
+    total += tab->_items.size();
+    for (unsigned int i = 0; i < tab->_children.size(); i++)
+      if (tab->_children[i] != NULL)
+	pending.push_back(tab->_children[i]);
+  }
   return total;
 }
 
@@ -7,10 +7,57 @@
 #ifndef __TABLEAU_H__
 #define __TABLEAU_H__
 
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <list>
+#include <map>
+#include <memory>
+#include <set>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 #include "formula.h"
+#include "scheduler.h"
+#include "stats.h"
+
+
+//////////////////////////////////////////////////////////////////////////////
+// An immutable set of PB decisions of a branch, given by their levels:
+// the decision of level l is the formula added by the l'th PB rule
+// applied on the branch, counting from 0. NULL is the empty set. Sets
+// are allocated in the current arena, like the signed formulas.
+//////////////////////////////////////////////////////////////////////////////
+
+class Dependencies
+{
+ public:
+  // Returns the set {level}.
+  static const Dependencies *single(unsigned int level);
+
+  // Returns the set {0, ..., n - 1}.
+  static const Dependencies *range(unsigned int n);
+
+  // Returns the union of a and b.
+  static const Dependencies *merge(const Dependencies *a,
+				   const Dependencies *b);
+
+  // Returns a without level.
+  static const Dependencies *remove(const Dependencies *a,
+				    unsigned int level);
+
+  // Returns true if level is in a.
+  static bool contains(const Dependencies *a, unsigned int level);
+
+  // Number of levels, and the levels in increasing order.
+  unsigned int size;
+  unsigned int levels[1];
+
+ private:
+  // Returns a new set with the levels in v, which must be sorted.
+  static const Dependencies *make(const vector<unsigned int>& v);
+};
 
 
 //////////////////////////////////////////////////////////////////////////////
@@ -23,6 +70,10 @@ class SignedFormula
   enum Sign {S_F, S_T};
   SignedFormula(Sign s, Formula *fml);
 
+  // Signed formulas are allocated in the current arena, if any.
+  static void *operator new(size_t size) { return Arena::alloc(size); }
+  static void operator delete(void *p) { Arena::dealloc(p); }
+
   // Formula types.
   enum fmlType {ALPHA, BETA, LITERAL};
 
@@ -32,41 +83,425 @@ class SignedFormula
   // Returns a string representation of the formula.
   string toString() const;
 
-  // Returns the value of the formula according to a valuation. Returns:
+  // Returns an integer identifying the signed formula. Structurally
+  // equal signed formulas have the same key.
+  unsigned int key() const { return 2 * formula->id + sign; }
+
+  // Returns the value of the formula according to a valuation,
+  // indexed by atom id. Returns:
   // -1: undefined
   //  0: false
   //  1: true
-  int value(map<string, int>& valuation) const;
+  int value(const vector<int>& valuation) const;
 
-  // Returns the polarity of the specified atom in the formula. Returns:
+  // Returns the polarity of the atom with the specified id in the
+  // formula. Returns:
   // -1: no ocurrences of this atom on the formula
   //  0: negative polarity
   //  1: positive polarity
   //  2: ocurrences of both polarities
-  int polarity(const string& atom) const;  
+  int polarity(unsigned int atom) const;
 
   // Counts the number of ocurrences of atoms in the formula that are
   // described in valuation.
-  unsigned int atomsIn(const map<string, int>& valuation) const;
+  unsigned int atomsIn(const vector<int>& valuation) const;
 
   // Counts the number of ocurrences of atoms in the formula that are
   // not described in valuation.
-  unsigned int atomsOut(const map<string, int>& valuation) const;
+  unsigned int atomsOut(const vector<int>& valuation) const;
 
   // Counts the number of ocurrences of atoms in the formula that are
-  // not described in the atom set.
-  unsigned int atomsOut(const set<string>& atomset) const;
+  // not described in the atom set, indexed by atom id.
+  unsigned int atomsOut(const vector<bool>& atomset) const;
 
   // Returns the distance between the formula and the set of atoms in
-  // the valuation. This distance is the minimum distance between an
-  // atom occurring in the formula and an atom described in the
-  // valuation.
-  double distanceFrom(const map<string, int>& valuation,
-		      const map<string, int>& atom_dist) const;
+  // a valuation. nearest[a] is the distance between the atom a and the
+  // nearest atom described in the valuation (INT_MAX if unknown).
+  double distanceFrom(const vector<int>& nearest) const;
 
   Sign sign;
+  // A canonical formula (see FormulaFactory). The conclusions of the
+  // rules share the subformulas of their premises, so it must not be
+  // modified.
   Formula *formula;
   fmlType ty;
+
+  // The PB decisions the formula depends on, tracked by the KE
+  // tableaux in learning mode.
+  const Dependencies *deps;
+};
+
+
+//////////////////////////////////////////////////////////////////////////////
+// Encapsulates the distances between atoms, indexed by atom id. They
+// are the distances in a graph of the nodes of the formula tree and of
+// its atoms, set once by the owner of the object. Each row (the
+// distances from an atom to all the others) is computed by a Dijkstra
+// search the first time it is needed, so a proof only pays for the
+// atoms its strategy looks at. Up to DENSE_ATOMS atoms, the rows are
+// kept as computed, making a matrix; above, only the last CACHED_ROWS
+// rows are kept. Copies share the graph and the rows, and may be used
+// by several threads at once.
+//////////////////////////////////////////////////////////////////////////////
+
+class AtomDistance
+{
+ public:
+  // Distance between atoms that do not occur in the formula tree.
+  static const int NONE = INT_MAX;
+
+  static const unsigned int DENSE_ATOMS = 1024;
+  static const unsigned int CACHED_ROWS = 256;
+
+  // The graph: parent and weight give the tree of n nodes (parent -1
+  // for the root), and occurrences the nodes where each atom occurs.
+  // Any two nodes not linked by an edge are at distance jump. An atom
+  // moves between its occurrences at no cost. atoms is the number of
+  // atom ids.
+  void init(const vector<int>& parent, const vector<int>& weight,
+	    const map<unsigned int, set<int> >& occurrences, int jump,
+	    unsigned int atoms);
+
+  int get(unsigned int a, unsigned int b) const;
+
+  // Returns the distances from the atom a to each atom, or NULL if a
+  // does not occur in the formula tree.
+  shared_ptr<const vector<int> > row(unsigned int a) const;
+
+  // Returns, for each atom a, the minimum distance between a and an
+  // atom described in valuation (NONE if there is no such atom).
+  vector<int> nearest(const vector<int>& valuation) const;
+
+ private:
+  struct Graph;
+
+  // The graph and the rows, shared by the copies of the object.
+  shared_ptr<Graph> _g;
+};
+
+
+//////////////////////////////////////////////////////////////////////////////
+// Encapsulates the state of the branch being expanded: the alpha and
+// the beta formulas not yet analysed and the literals. It is shared by
+// all the nodes of a tableau. Every change is recorded in a trail, so
+// a child is expanded in place and its changes are undone when it is
+// done, instead of copying the state of its parent.
+//////////////////////////////////////////////////////////////////////////////
+
+class BranchState
+{
+ public:
+  BranchState()
+    : _stamp(0), _contradictions(0), _conflict(0), _tracking(false),
+      _stale(0) { }
+
+  vector<SignedFormula *> alphas, betas, lits;
+
+  // Returns a mark of the current state, to be passed to undo().
+  unsigned int mark() const { return _trail.size(); }
+
+  // Appends fml to v (alphas, betas or lits).
+  void push(vector<SignedFormula *>& v, SignedFormula *fml);
+
+  // Returns true if a signed formula with the key of fml was pushed
+  // in the branch (even if it was erased since).
+  bool seen(const SignedFormula *fml) const
+  { return seen(fml->key()); }
+  bool seen(unsigned int key) const
+  { return key < _pushed.size() && _pushed[key] != NULL; }
+
+  // Returns a hash of the formulas of the branch that still matter:
+  // the alphas and the betas not made true by the valuation, and the
+  // literals on their atoms. The other formulas follow from them or
+  // can be satisfied apart, so two branches with the same such
+  // formulas are both closed or both open. The hash is the xor of a
+  // random number per key (Zobrist hashing), so equal sets have equal
+  // hashes whatever the order of their formulas. Puts in keys the
+  // sorted keys of the formulas, which identify the set exactly.
+  unsigned long long hash(vector<unsigned int>& keys);
+
+  // Erases the index'th formula of v (alphas, betas or lits).
+  void erase(vector<SignedFormula *>& v, unsigned int index);
+
+  // Undoes all the changes made after the mark m.
+  void undo(unsigned int m);
+
+  // Records that the PB rule was applied on the beta fml.
+  void applyPB(SignedFormula *fml);
+
+  // Returns true if the PB rule was applied on a beta with the key of
+  // fml in the branch, that is, in the current node or in one of its
+  // ancestors.
+  bool appliedPB(const SignedFormula *fml) const
+  { return fml->key() < _appliedPB.size() && _appliedPB[fml->key()]; }
+
+  // Returns the valuation given by lits, indexed by atom id: -1
+  // (undefined, or both T a and F a), 0 (F a) or 1 (T a).
+  const vector<int>& valuation() const { return _valuation; }
+
+  // Returns true if lits contains both T a and F a, for some atom a.
+  bool contradictory() const { return _contradictions > 0; }
+
+  // Adds a nogood: a set of signed formulas that cannot all be in a
+  // branch, whatever the PB decisions. Nogoods are kept by undo().
+  void learn(const vector<SignedFormula *>& nogood);
+
+  // Returns true if all the formulas of a nogood are in the branch.
+  // Otherwise sets lemma to a new formula, the opposite of the only
+  // formula of a nogood not in the branch (if there is such a nogood
+  // and the opposite is not in the branch either), or to NULL.
+  bool propagate(SignedFormula *&lemma);
+
+  // Returns the dependencies of the contradiction of the branch: a
+  // pair T a, F a in lits, or a nogood in the branch.
+  const Dependencies *conflict() const;
+
+  // Makes room for n atoms in the valuation.
+  void reserveAtoms(unsigned int n);
+
+  // Returns, for each atom a, the minimum distance by dist between a
+  // and an atom described in the valuation (see
+  // AtomDistance::nearest()). From the first call on, the distances
+  // are kept up to date as literals are pushed and undone, instead of
+  // being computed again at each call.
+  const vector<int>& nearest(const AtomDistance& dist);
+
+  // Looks for the first beta formula that can be eliminated with one
+  // of the literals of the branch by a KE beta rule. Sets beta and lit
+  // to their positions in betas and lits (the first such literal).
+  // Returns false if there is no such pair.
+  bool applicableBeta(unsigned int& beta, unsigned int& lit) const;
+
+ private:
+  // A change in one of the vectors. fml is NULL if a formula was
+  // appended to v, or the formula erased from position index of v.
+  // v points to a member, so a copy of the state has a valid trail.
+  // v is NULL if the PB rule was applied on the beta fml.
+  struct Change {
+    vector<SignedFormula *> BranchState::*v;
+    unsigned int index;
+    SignedFormula *fml;
+  };
+
+  vector<Change> _trail;
+
+  // Indexed by key: the signed formula with the key pushed in the
+  // branch, or NULL.
+  vector<SignedFormula *> _pushed;
+
+  // Scratch space of hash(): the atoms of a formula, and the atoms
+  // occurring in the formulas hashed so far.
+  vector<unsigned int> _atoms;
+  vector<bool> _relevant;
+
+  // Indexed by key: true if the PB rule was applied on a beta with the
+  // key.
+  vector<bool> _appliedPB;
+
+  // Index of the betas by the literals that eliminate them, like the
+  // watched literals of a SAT solver. keys holds the keys of those
+  // literals; hits counts how many of them are in lits.
+  struct BetaEntry {
+    unsigned long stamp;
+    vector<unsigned int> keys;
+    unsigned int hits;
+    bool active;
+  };
+
+  // Returns the member v refers to.
+  vector<SignedFormula *> BranchState::*member(vector<SignedFormula *>& v);
+
+  void pushBeta(SignedFormula *fml);
+  void popBeta(SignedFormula *fml);
+  void pushLit(SignedFormula *fml);
+  void popLit(SignedFormula *fml);
+
+  // Updates the value of the atom of the literal lit.
+  void updateValue(const SignedFormula *lit);
+
+  // Update the distances to the valuation after the value of atom
+  // changed from before, in pushLit(), and undo that in popLit().
+  void trackValue(unsigned int atom, int before);
+  void untrackValue();
+
+  // Betas in the index, with the betas watching each literal key.
+  unordered_map<SignedFormula *, BetaEntry> _betaIndex;
+  vector<vector<SignedFormula *> > _watch;
+
+  // Number of literals in lits with each key, and the position of
+  // the first of them.
+  vector<unsigned int> _litCount, _firstLit;
+
+  // Betas in betas having a literal in lits, ordered by stamp. Betas
+  // are appended to betas with increasing stamps, so this is also
+  // their order in betas. The stamp of a popped beta is reused.
+  map<unsigned long, SignedFormula *> _applicable;
+  unsigned long _stamp;
+
+  // Counts the betas in betas by stamp, in a Fenwick tree (1-based,
+  // of a power of two size), so the position of a beta in betas, the
+  // number of betas with a smaller stamp, takes O(log n).
+  vector<unsigned int> _betaCount;
+  void countBeta(unsigned long stamp, int delta);
+  unsigned int betaPosition(unsigned long stamp) const;
+
+  // The valuation given by lits, and the number of atoms a with both
+  // T a and F a in lits. If there is any, _conflict is the key of the
+  // first such T a or F a pushed.
+  vector<int> _valuation;
+  unsigned int _contradictions;
+  unsigned int _conflict;
+
+  // The distances to the valuation, once tracked (see nearest()). Each
+  // value set by pushLit() adds an event, with the size of the trail
+  // of the distances changed before it. An atom leaving the valuation
+  // (with both T a and F a) makes the distances stale, as they cannot
+  // grow back, until it is undone.
+  struct NearestChange {
+    unsigned int atom;
+    int distance;
+  };
+  struct NearestEvent {
+    unsigned int trail;
+    bool left;
+  };
+  AtomDistance _dist;
+  bool _tracking;
+  vector<int> _nearest, _staleNearest;
+  vector<NearestChange> _nearestTrail;
+  vector<NearestEvent> _nearestEvents;
+  unsigned int _stale;
+
+  // Updates the nogoods containing the key of fml, pushed (delta = 1)
+  // or popped (delta = -1).
+  void countNogoods(const SignedFormula *fml, int delta);
+
+  // The nogoods, with the number of their formulas in the branch, and
+  // the nogoods containing each key. _ready holds the nogoods having
+  // at most one formula missing from the branch.
+  struct Nogood {
+    vector<SignedFormula *> fmls;
+    unsigned int present;
+  };
+  vector<Nogood> _nogoods;
+  vector<vector<unsigned int> > _nogoodWatch;
+  set<unsigned int> _ready;
+
+  // The sorted keys of the nogoods, to learn each one once.
+  set<vector<unsigned int> > _learned;
+};
+
+
+//////////////////////////////////////////////////////////////////////////////
+// Encapsulates a bounded set of branch states known to be closed, so a
+// tableau reaching one of them again can close at once. A state is
+// looked up by its hash (see BranchState::hash()), but found only if
+// its keys are equal too, so a collision of hashes cannot close an
+// open branch. When the table is full, inserting evicts states
+// according to the policy:
+// - LRU: the states looked up or inserted least recently;
+// - FIFO: the states inserted first;
+// - REPLACE: the state in the same slot of a direct-mapped array.
+// It may be shared by the threads closing a tableau.
+//////////////////////////////////////////////////////////////////////////////
+
+class TranspositionTable
+{
+ public:
+  enum Policy {LRU, FIFO, REPLACE};
+
+  // Creates a table holding at most about bytes bytes of states.
+  TranspositionTable(size_t bytes, Policy policy = LRU);
+
+  // Returns true if the state with hash and keys is in the table.
+  bool lookup(unsigned long long hash, const vector<unsigned int>& keys);
+
+  // Adds the state with hash and keys to the table.
+  void insert(unsigned long long hash, const vector<unsigned int>& keys);
+
+  // Returns the number of successful lookups.
+  unsigned long hits() const;
+
+ private:
+  TranspositionTable(const TranspositionTable&);
+  TranspositionTable& operator=(const TranspositionTable&);
+
+  // A state: its hash and its keys (none if the slot is empty).
+  struct Entry {
+    unsigned long long hash;
+    vector<unsigned int> keys;
+  };
+
+  // Returns the approximate memory taken by an entry with keys.
+  size_t entryBytes(const vector<unsigned int>& keys) const;
+
+  Policy _policy;
+  size_t _bytes, _used;
+
+  // LRU and FIFO: the states from the next to be evicted to the last
+  // one, and their positions in the list by hash.
+  list<Entry> _order;
+  unordered_map<unsigned long long, list<Entry>::iterator> _entries;
+
+  // REPLACE: the slots.
+  vector<Entry> _slots;
+
+  unsigned long _hits;
+  mutable mutex _mutex;
+};
+
+
+//////////////////////////////////////////////////////////////////////////////
+// Encapsulates the limits of the work of close(): on the nodes
+// expanded, on the formulae of those nodes, on the bytes held by an
+// arena and on the wall time since the budget was created. A limit of
+// 0 means none. The counts are checked at every node, the bytes and
+// the time only every CHECK_PERIOD nodes, as they cost more. It may be
+// shared by the threads closing a tableau.
+//////////////////////////////////////////////////////////////////////////////
+
+class Budget
+{
+ public:
+  // The resource of the first limit exceeded.
+  enum Resource {NONE, NODES, FORMULAE, BYTES, TIME};
+
+  // Creates a budget whose bytes are those held by arena (or the
+  // current arena, if NULL).
+  Budget(unsigned long nodes, unsigned long formulae,
+	 size_t bytes, double seconds, const Arena *arena = NULL);
+
+  // Accounts for a node expanded with formulae formulae. Returns false
+  // if a limit is exceeded.
+  bool spend(unsigned long formulae);
+
+  // Returns the resource of the first limit exceeded, or NONE.
+  Resource exceeded() const { return (Resource) _exceeded.load(); }
+
+  // Returns the name of a resource.
+  static const char *name(Resource resource);
+
+  // Returns the nodes and formulae spent so far.
+  unsigned long nodes() const { return _nodes.load(); }
+  unsigned long formulae() const { return _formulae.load(); }
+
+ private:
+  Budget(const Budget&);
+  Budget& operator=(const Budget&);
+
+  static const unsigned long CHECK_PERIOD = 64;
+
+  // Records resource as exceeded, unless another one was first.
+  void exceed(Resource resource);
+
+  unsigned long _maxNodes, _maxFormulae;
+  size_t _maxBytes;
+  double _maxSeconds;
+  const Arena *_arena;
+  chrono::steady_clock::time_point _start;
+
+  atomic<unsigned long> _nodes, _formulae;
+  atomic<int> _exceeded;
 };
 
 
@@ -89,18 +524,16 @@ class TableauStrategy
   virtual ~TableauStrategy();
   
   // initializes the object with the items of a tableau. Returns true
-  // if the tableau is already close.  This method also uses the
-  // Floyd-Warshall algorithm to calculate the minimum distance
-  // between each pair of atoms.
+  // if the tableau is already close.  In the first call, this method
+  // also calculates the minimum distance between each pair of atoms.
   bool init(const string& tableau_id,
 	    vector<SignedFormula *> *items,
-	    vector<SignedFormula *> *alphas,
-	    vector<SignedFormula *> *betas,
-	    vector<SignedFormula *> *lits);
+	    BranchState *branch);
 
   // classifies the formulas in the vector items. Puts them into the
-  // corresponding vector: alphas, betas or lits. Returns true if the
-  // tableau is closed.
+  // corresponding vector of the branch: alphas, betas or lits, unless
+  // a structurally equal signed formula is already in the branch.
+  // Returns true if the tableau is closed.
   bool classify(unsigned int& index);
 
   // choose the next alpha formula to be analysed. Returns the index
@@ -112,34 +545,39 @@ class TableauStrategy
   virtual int nextRule() = 0;
   
  protected:
-  // Initializes M and atom2node, which will be used in the F-W algorithm.
-  void init_floyd_warshall(Formula *fml, int nt, int nf,
-			   int **M, map<string, set<int> >& atom2node,
-			   int parent, int *next_node, int level);
+  // Builds the tree of connective nodes of fml, used to calculate the
+  // distances between atoms: parent[v] and weight[v] are the parent of
+  // node v and the weight of the edge between them. atom2node maps
+  // each atom id to the nodes where it occurs.
+  void init_distances(Formula *fml,
+		      vector<int>& parent, vector<int>& weight,
+		      map<unsigned int, set<int> >& atom2node,
+		      int parentnode, int level);
 
   // the id of the tableau associated to this strategy object.
   string id;
 
   vector<SignedFormula *> *_items;
+
+  BranchState *_branch;
   
   vector<SignedFormula *> *_alphas;
   vector<SignedFormula *> *_betas;
   vector<SignedFormula *> *_lits;
 
-  // if _mlits[str] = 1, we have F str
-  // if _mlits[str] = 2, we have T str
-  // if _mlits[str] = 3, we have both
-  map<string, int> _mlits;
+  // Returns the valuation given by the literals in the branch, indexed
+  // by atom id: -1 (undefined), 0 (F a) or 1 (T a).
+  const vector<int>& branchValuation() const
+  { return _branch->valuation(); }
 
-  // Map of distances between connective nodes, calculated by the
-  // Floyd-Warshall algorithm in the first call to the init()
-  // method. For a pair of atoms a and b, the key is "a,b".
-  map<string, int> _atom_dist;
+  // Distances between atoms, calculated in the first call to the
+  // init() method.
+  AtomDistance _atom_dist;
 
   // Maximum atom distance.
   int _max_atom_dist;
 
-  // indicates if the F-W algorithm was already run in this object.
+  // indicates if the distances were already calculated in this object.
   bool _fw_done;
 };
 
@@ -151,20 +589,46 @@ class TableauStrategy
 class Tableau
 {
  public:
+  // The tableau shares the branch state of its parent, unless branch
+  // is given. The tableau owns branch and the state of a root.
   Tableau(const string& id, SignedFormula *fml,
-	  Tableau *parent = NULL);
+	  Tableau *parent = NULL, BranchState *branch = NULL);
   Tableau(const string& id, const vector<SignedFormula *>& fmls,
-	  Tableau *parent = NULL);
+	  Tableau *parent = NULL, BranchState *branch = NULL);
   virtual ~Tableau();
 
+  // Tableaux are allocated in the current arena, if any. The arena
+  // owns the nodes, so a tableau does not delete its children.
+  static void *operator new(size_t size) { return Arena::alloc(size, finalize); }
+  static void operator delete(void *p) { Arena::dealloc(p); }
+
   // Sets the strategy object.
   virtual void setStrategy(TableauStrategy *strategy);
 
   // String representation of the tableau.
-  virtual string toString(int level=0) const;
+  string toString(int level=0) const;
+
+  // Tries to close the tableau (returns true if successful). The
+  // nodes are expanded with an explicit stack, so the depth of the
+  // tableau is limited only by memory.
+  bool close();
+
+  // Sets a flag that makes close() give up, leaving the nodes not yet
+  // expanded as they are, when another thread sets it. The children
+  // created afterwards share it.
+  void setCancel(const atomic<bool> *cancel) { _cancel = cancel; }
+
+  // Sets a budget that makes close() give up in the same way once one
+  // of its limits is exceeded. The children share it.
+  void setBudget(Budget *budget) { _budget = budget; }
 
-  // Tries to close the tableau (returns true if successful).
-  virtual bool close() = 0;
+  // Sets the statistics kept by the tableau. The children share them.
+  // Must be called before setStrategy() for its time to count.
+  void setStats(Stats *stats) { _stats = stats; }
+
+  // Returns true if close() gave up, because the flag was set or the
+  // budget exceeded: then its result means nothing (unknown).
+  bool cancelled() const { return _cancelled; }
 
   // Returns the total number of nodes of the tableau (including children).
   unsigned int countNodes();
@@ -173,6 +637,21 @@ class Tableau
   unsigned int countFormulae();
 
  protected:
+  // Results of expand() and resume(): the node is closed, it is open,
+  // or it created a child (the last one in _children) that must be
+  // closed before going on.
+  enum Step {CLOSED, OPEN, SPLIT};
+
+  // Expands the node until it is closed, open or split.
+  virtual Step expand() = 0;
+
+  // Goes on expanding the node after its last child was closed or
+  // found open (closed tells which).
+  virtual Step resume(bool closed) = 0;
+
+  // String representation of the formulae of the node.
+  virtual string nodeToString(int level) const;
+
   // Applies the index'th rule of the tableau. Returns true if successful.
   bool applyRule(unsigned int index,
 		 const vector<SignedFormula *>& in,
@@ -193,9 +672,69 @@ class Tableau
   // Id of the tableau.
   string _id;
 
+  // State of the branch, shared with the parent and the children.
+  BranchState *_branch;
+  bool _ownsBranch;
+
+  // The flag of setCancel() and the budget of setBudget() (or NULL),
+  // and whether close() gave up.
+  const atomic<bool> *_cancel;
+  Budget *_budget;
+  bool _cancelled;
+
+  // The statistics of setStats() (or NULL), and the depth of the node
+  // (0 for the root).
+  Stats *_stats;
+  unsigned int _depth;
+
  private:
+  // Returns true if close() must give up.
+  bool stopped() const
+  { return (_cancel != NULL && _cancel->load()) ||
+      (_budget != NULL && _budget->exceeded() != Budget::NONE); }
+
+  // Expands the node, accounting for it in the budget and the
+  // statistics.
+  Step expandNode();
+
+  // Destroys a tableau allocated in an arena.
+  static void finalize(void *p);
+
   // Strategy of the tableau.
   TableauStrategy *_strategy;
 };
 
+
+//////////////////////////////////////////////////////////////////////////////
+// A task that tries to close a tableau.
+//////////////////////////////////////////////////////////////////////////////
+
+class CloseTask : public Task
+{
+ public:
+  // The task allocates in the current arena and builds formulas in
+  // the current factory of the creating thread.
+  CloseTask(Tableau *tab)
+    : closed(false), _tab(tab), _arena(Arena::current()),
+      _factory(FormulaFactory::current()) { }
+
+  virtual void run()
+  {
+    ArenaScope scope(_arena);
+    FactoryScope factory(_factory);
+    closed = _tab->close();
+  }
+
+  // Returns the tableau to close.
+  Tableau *tableau() const { return _tab; }
+
+  // Result of the call to close().
+  bool closed;
+
+ private:
+  Tableau *_tab;
+  Arena *_arena;
+  FormulaFactory *_factory;
+};
+
 #endif